@@ -0,0 +1,175 @@
+#include <string.h>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "BlockCompress.h"
+
+size_t bc1Size(int width, int height)
+{
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * 8;
+}
+
+static inline uint16_t to565(uint32_t bgra)
+{
+    return static_cast<uint16_t>((((bgra >> 16) & 0xf8) << 8) | (((bgra >> 8) & 0xfc) << 3) | ((bgra & 0xff) >> 3));
+}
+
+static inline void from565(uint16_t c, int rgb[3])
+{
+    int r = c >> 11, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// min and max per channel of 16 pixels, packed like the pixels
+static void boundsScalar(const uint32_t* block, uint32_t& lo, uint32_t& hi)
+{
+    lo = 0xffffffff;
+    hi = 0;
+    for (auto shift : {0, 8, 16})
+    {
+        uint32_t mn{0xff}, mx{0};
+        for (auto i = 0; i < 16; ++i)
+        {
+            auto v = (block[i] >> shift) & 0xff;
+            mn = std::min(mn, v);
+            mx = std::max(mx, v);
+        }
+        lo = (lo & ~(0xffu << shift)) | (mn << shift);
+        hi = (hi & ~(0xffu << shift)) | (mx << shift);
+    }
+}
+
+#ifdef __SSE2__
+static void boundsSimd(const uint32_t* block, uint32_t& lo, uint32_t& hi)
+{
+    auto p = reinterpret_cast<const __m128i*>(block);
+    auto r0 = _mm_loadu_si128(p), r1 = _mm_loadu_si128(p + 1);
+    auto r2 = _mm_loadu_si128(p + 2), r3 = _mm_loadu_si128(p + 3);
+    auto mn = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+    auto mx = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+    mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, 0x4e));
+    mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, 0x4e));
+    mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, 0xb1));
+    mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, 0xb1));
+    // alpha is not used, keep it like scalar
+    lo = (static_cast<uint32_t>(_mm_cvtsi128_si32(mn)) & 0x00ffffff) | 0xff000000;
+    hi = static_cast<uint32_t>(_mm_cvtsi128_si32(mx)) & 0x00ffffff;
+}
+#endif
+
+static void encodeBlock(const uint32_t* block, uint8_t* out, bool simd)
+{
+    uint32_t lo, hi;
+#ifdef __SSE2__
+    if (simd)
+    {
+        boundsSimd(block, lo, hi);
+    }else
+#endif
+    {
+        (void)simd;
+        boundsScalar(block, lo, hi);
+    }
+
+    // inset box by 1/16, fewer pixels land on the worse end colors
+    uint32_t inLo{0}, inHi{0};
+    for (auto shift : {0, 8, 16})
+    {
+        int mn = (lo >> shift) & 0xff;
+        int mx = (hi >> shift) & 0xff;
+        int inset = (mx - mn) >> 4;
+        inLo |= static_cast<uint32_t>(mn + inset) << shift;
+        inHi |= static_cast<uint32_t>(mx - inset) << shift;
+    }
+    auto c0 = to565(inHi);
+    auto c1 = to565(inLo);
+    uint32_t indices{0};
+    if (c0 < c1)
+    {
+        std::swap(c0, c1);
+    }
+    if (c0 != c1)
+    {
+        int palette[4][3];
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (auto c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (auto i = 0; i < 16; ++i)
+        {
+            int rgb[3] = {int((block[i] >> 16) & 0xff), int((block[i] >> 8) & 0xff), int(block[i] & 0xff)};
+            auto best{0};
+            auto bestDistance{1 << 30};
+            for (auto j = 0; j < 4; ++j)
+            {
+                auto dr = rgb[0] - palette[j][0], dg = rgb[1] - palette[j][1], db = rgb[2] - palette[j][2];
+                auto distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = j;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+        }
+    }
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    memcpy(out + 4, &indices, 4);
+}
+
+void compressBc1(const uint8_t* bgra, int width, int height, uint8_t* out, bool simd)
+{
+    auto pixels = reinterpret_cast<const uint32_t*>(bgra);
+    uint32_t block[16];
+    for (auto by = 0; by < height; by += 4)
+    {
+        for (auto bx = 0; bx < width; bx += 4)
+        {
+            for (auto y = 0; y < 4; ++y)
+            {
+                auto row = pixels + size_t(std::min(by + y, height - 1)) * width;
+                if (bx + 4 <= width)
+                {
+                    memcpy(block + y * 4, row + bx, 16);
+                    continue;
+                }
+                for (auto x = 0; x < 4; ++x)
+                {
+                    block[y * 4 + x] = row[std::min(bx + x, width - 1)];
+                }
+            }
+            encodeBlock(block, out, simd);
+            out += 8;
+        }
+    }
+}
+
+uint64_t hashPixels(const uint8_t* data, size_t bytes)
+{
+    // word at a time multiply-xor, collisions only cost a missed upload
+    uint64_t hash{0x9e3779b97f4a7c15ull ^ bytes};
+    size_t i{0};
+    for (; i + 8 <= bytes; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    for (; i < bytes; ++i)
+    {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// BC1 (DXT1) encoder for window contents that stopped changing, half a byte
+// per pixel instead of four. Endpoints are the inset bounding box of each 4x4
+// block, good enough for text and flat UI and fast enough for one idle priority
+// encode thread.
+
+// bytes of BC1 data for image, partial blocks at edges included
+size_t bc1Size(int width, int height);
+
+// Encodes tightly packed BGRA rows, alpha is dropped. Edge blocks repeat last
+// row/column. simd selects vector code where the cpu has it, output is the
+// same either way.
+void compressBc1(const uint8_t* bgra, int width, int height, uint8_t* out,
+                 bool simd = true);
+
+// cheap 64 bit hash telling if captured content changed
+uint64_t hashPixels(const uint8_t* data, size_t bytes);
@@ -0,0 +1,710 @@
+// Capture path benchmark. Starts Xvfb, opens a number of animated windows and
+// runs the XServerMirror capture/convert pipeline against them once per
+// capture backend. Reports captures/s, MB/s and latency percentiles.
+//
+// capture_bench [--windows N] [--size WxH]... [--seconds S] [--display :N]
+//               [--depth 16|24] [--no-xvfb] [--min-rate CAPTURES_PER_SEC]
+//               [--trace FILE]
+// capture_bench --convert [--size WxH] [--seconds S]
+// capture_bench --latency [--max-latency MS] [--seconds S] [--display :N]
+//
+// Exit code is non-zero if any backend is below --min-rate, so it can gate
+// capture path changes on a headless box. --convert benchmarks every pixel
+// converter, scalar and simd, without X and fails if their outputs differ.
+// --latency paints timestamps into a window and sends them the mirror way,
+// capture, convert, texture upload, instanced draw and buffer swap, into a
+// window on the same server; a timestamp counts once it is read back from
+// there. Fails if 90th percentile is above --max-latency.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_syswm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "CaptureFile.h"
+#include "EyeViews.h"
+#include "InstanceBatch.h"
+#include "PixelConvert.h"
+#include "BlockCompress.h"
+#include "TypesConf.h"
+#include "WindowCapture.h"
+#include "XServerMirror.h"
+
+struct Size
+{
+    unsigned int width, height;
+};
+
+struct Options
+{
+    size_t windows{8};
+    std::vector<Size> sizes;
+    int seconds{5};
+    int depth{24};
+    bool convert{false};
+    bool latency{false};
+    double maxLatencyMs{100};
+    std::string display{":99"};
+    bool startXvfb{true};
+    double minRate{0};
+    std::string trace;
+};
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options opt;
+    for (auto i{1}; i < argc; ++i)
+    {
+        std::string arg{argv[i]};
+        auto next = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                throw Error("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+        if (arg == "--windows")
+        {
+            opt.windows = std::stoul(next());
+        } else if (arg == "--size")
+        {
+            Size size;
+            if (sscanf(next().c_str(), "%ux%u", &size.width, &size.height) != 2)
+            {
+                throw Error("bad size, use WxH");
+            }
+            opt.sizes.push_back(size);
+        } else if (arg == "--seconds")
+        {
+            opt.seconds = std::stoi(next());
+        } else if (arg == "--depth")
+        {
+            opt.depth = std::stoi(next());
+        } else if (arg == "--convert")
+        {
+            opt.convert = true;
+        } else if (arg == "--latency")
+        {
+            opt.latency = true;
+        } else if (arg == "--max-latency")
+        {
+            opt.maxLatencyMs = std::stod(next());
+        } else if (arg == "--display")
+        {
+            opt.display = next();
+        } else if (arg == "--no-xvfb")
+        {
+            opt.startXvfb = false;
+        } else if (arg == "--min-rate")
+        {
+            opt.minRate = std::stod(next());
+        } else if (arg == "--trace")
+        {
+            opt.trace = next();
+        } else
+        {
+            throw Error("unknown option " + arg);
+        }
+    }
+    if (opt.sizes.empty())
+    {
+        opt.sizes = {{640, 480}, {1280, 720}, {1920, 1080}};
+    }
+    return opt;
+}
+
+static pid_t startXvfb(const std::string& display, int depth)
+{
+    auto screen = "3840x2160x" + std::to_string(depth);
+    auto pid = fork();
+    if (pid == 0)
+    {
+        execlp("Xvfb", "Xvfb", display.c_str(), "-screen", "0", screen.c_str(),
+               "-nolisten", "tcp", nullptr);
+        perror("Xvfb");
+        _exit(127);
+    }
+    return pid;
+}
+
+static Display* connect(const std::string& display)
+{
+    for (auto i{0}; i < 100; ++i)
+    {
+        auto dpy = XOpenDisplay(display.c_str());
+        if (dpy != nullptr)
+        {
+            return dpy;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    throw Error("unable to connect to " + display);
+}
+
+// scripted content: scrolling stripes and a bouncing block, like a busy
+// terminal next to a video
+static void animate(std::string displayName, std::vector<Window> windows,
+                    std::vector<Size> sizes, std::atomic<bool>* exit)
+{
+    auto dpy = connect(displayName);
+    std::vector<GC> gcs;
+    for (auto window : windows)
+    {
+        gcs.push_back(XCreateGC(dpy, window, 0, nullptr));
+    }
+    for (unsigned long frame{0}; !*exit; ++frame)
+    {
+        for (size_t i = 0; i < windows.size(); ++i)
+        {
+            auto& size = sizes[i];
+            for (unsigned int y = 0; y < size.height; y += 16)
+            {
+                XSetForeground(dpy, gcs[i], ((y + frame * 4) * 2654435761u) & 0xffffff);
+                XFillRectangle(dpy, windows[i], gcs[i], 0, y, size.width, 16);
+            }
+            auto bx = (frame * 7) % size.width;
+            auto by = (frame * 5) % size.height;
+            XSetForeground(dpy, gcs[i], 0xffffff);
+            XFillRectangle(dpy, windows[i], gcs[i], bx, by, size.width / 8, size.height / 8);
+        }
+        XSync(dpy, False);
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+    for (auto gc : gcs)
+    {
+        XFreeGC(dpy, gc);
+    }
+    XCloseDisplay(dpy);
+}
+
+struct Result
+{
+    size_t captures{0};
+    size_t bytes{0};
+    double seconds{0};
+    std::vector<uint64_t> latencyUs;
+};
+
+// same steps as Mirror::thrFnc: attributes, grab, convert
+static Result runBackend(Display* dpy, WindowCapture::Backend backend,
+                         const std::vector<Window>& windows, int seconds,
+                         CaptureRecorder* recorder)
+{
+    WindowCapture capture(dpy, backend);
+    Result result;
+    if (capture.backend() != backend)
+    {
+        return result;
+    }
+
+    std::vector<uint8_t> out;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::seconds(seconds);
+    for (uint32_t cycle{0}; std::chrono::steady_clock::now() < end; ++cycle)
+    {
+        for (auto window : windows)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            XWindowAttributes gwa;
+            if (!XGetWindowAttributes(dpy, window, &gwa))
+            {
+                continue;
+            }
+            auto image = capture.grab(dpy, window, gwa, 0, 0, gwa.width, gwa.height);
+            if (image == nullptr)
+            {
+                continue;
+            }
+            out.resize(image->width * image->height * 4u);
+            if (convertImage(image, out.data(), 128))
+            {
+                result.bytes += out.size();
+                ++result.captures;
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            result.latencyUs.push_back(std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count());
+            if (recorder != nullptr)
+            {
+                recorder->write(window, cycle, image->width, image->height, out.data());
+            }
+            capture.release(image);
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+static uint64_t percentile(std::vector<uint64_t>& v, double p)
+{
+    if (v.empty())
+    {
+        return 0;
+    }
+    return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+}
+
+// latency stamps, 48 bits of microseconds as colors of left and right
+// half of a window, plain fills survive every step of the path exactly
+static const int kStampWidth{256};
+static const int kStampHeight{64};
+
+static uint64_t stampNow(std::chrono::steady_clock::time_point epoch)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+static void paintStamp(Display* dpy, Window window, GC gc, uint64_t stamp)
+{
+    XSetForeground(dpy, gc, stamp & 0xffffff);
+    XFillRectangle(dpy, window, gc, 0, 0, kStampWidth / 2, kStampHeight);
+    XSetForeground(dpy, gc, (stamp >> 24) & 0xffffff);
+    XFillRectangle(dpy, window, gc, kStampWidth / 2, 0, kStampWidth / 2, kStampHeight);
+    XSync(dpy, False);
+}
+
+// stamp in window grabbed and converted to BGRA, 0 if there is none
+static uint64_t readStamp(Display* dpy, Window window, WindowCapture& capture, std::vector<uint8_t>& bgra)
+{
+    XWindowAttributes gwa;
+    if (!XGetWindowAttributes(dpy, window, &gwa) || gwa.width < kStampWidth || gwa.height < kStampHeight)
+    {
+        return 0;
+    }
+    auto image = capture.grab(dpy, window, gwa, 0, 0, kStampWidth, kStampHeight);
+    if (image == nullptr)
+    {
+        return 0;
+    }
+    bgra.resize(kStampWidth * kStampHeight * 4);
+    auto converted = convertImage(image, bgra.data(), 255);
+    capture.release(image);
+    if (!converted)
+    {
+        return 0;
+    }
+    // middle of each half, away from edges filtering could blend
+    auto color = [&](int x) -> uint64_t
+    {
+        auto p = &bgra[(kStampHeight / 2 * kStampWidth + x) * 4];
+        return uint64_t(p[2]) << 16 | uint64_t(p[1]) << 8 | p[0];
+    };
+    return color(kStampWidth / 4) | color(kStampWidth * 3 / 4) << 24;
+}
+
+// one mirror going the way server mirrors go: capture worker into ring
+// slot or mImage, scheduled PBO upload, texture swap; no upload thread
+class LatencyMirror : public XServerMirror
+{
+public:
+    LatencyMirror(Display* display, Window window)
+        : XServerMirror(size_t(1) << 30, size_t(1) << 30)
+    {
+        mMirror = std::make_shared<Mirror>();
+        mMirror->name = "latency";
+        mMirror->display = display;
+        mMirror->window = window;
+        mMirror->budget = &mBudget;
+        // focused windows stay BGRA, stamp colors must come through exactly
+        mMirror->haveFocus = true;
+        // straight ahead for upload scheduler
+        mMirror->mConer[Mirror::lu] = mMirror->mConer[Mirror::rd] = Vec3f(0, 0, -5);
+        mMasterList.push_back(mMirror);
+    }
+
+    // capture, then what opengl thread does with it; false if nothing new
+    // made it to front texture
+    bool update()
+    {
+        mMirror->requests.post();
+        mMirror->responses.wait();
+        SDL_Event event{};
+        event.type = SDL_USEREVENT;
+        event.user.code = kUpload;
+        event.user.data2 = mMirror.get();
+        cl_float4 whereami{0, 0, 0, 0};
+        cl_float4 lookat{0, 0, -1, 0};
+        auto uploaded = mUploaded.load();
+        generateScene(event, whereami, lookat, nullptr);
+        frameStart(whereami, lookat, nullptr);
+        return mUploaded != uploaded;
+    }
+
+    // front texture filling viewport
+    InstanceBatch::Instance instance()
+    {
+        auto instance = mirrorInstance(mMirror.get());
+        instance.position[0] = instance.position[1] = 0.0f;
+        instance.position[2] = 5.0f;
+        instance.halfWidth = instance.halfHeight = 1.0f;
+        std::fill(instance.rotation, instance.rotation + 3, 0.0f);
+        instance.rotation[3] = 1.0f;
+        return instance;
+    }
+
+    GLuint texture() const
+    {
+        return mMirror->mTexture.name;
+    }
+
+private:
+    std::shared_ptr<Mirror> mMirror;
+};
+
+// capture to display through the same steps mirrors take, one window: a
+// stamp is painted, captured, uploaded and drawn, and the window showing it
+// must show that stamp and not the one before
+static int benchLatency(const Options& opt, Display* dpy)
+{
+    if (opt.depth != 24)
+    {
+        throw Error("latency stamps need --depth 24");
+    }
+    // stamp window and the one showing it side by side, nothing covers them
+    auto source = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0, kStampWidth, kStampHeight, 0, 0, 0);
+    XMapWindow(dpy, source);
+    auto gc = XCreateGC(dpy, source, 0, nullptr);
+    XSync(dpy, False);
+
+    setenv("DISPLAY", opt.display.c_str(), 1);
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        throw Error(std::string("SDL_Init failed ") + SDL_GetError());
+    }
+    auto window = SDL_CreateWindow("capture_bench", kStampWidth * 2, 0, kStampWidth, kStampHeight,
+                                   SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
+    auto context = window ? SDL_GL_CreateContext(window) : nullptr;
+    SDL_SysWMinfo info;
+    SDL_VERSION(&info.version);
+    if (context == nullptr || !SDL_GetWindowWMInfo(window, &info))
+    {
+        throw Error(std::string("no OpenGL window ") + SDL_GetError());
+    }
+    auto shown = info.info.x11.window;
+    glewInit();
+    if (!InstanceBatch::supported())
+    {
+        throw Error("OpenGL 3.3 with vertex array objects needed");
+    }
+    // no vsync on Xvfb anyway, swaps must not wait for one elsewhere
+    SDL_GL_SetSwapInterval(0);
+
+    EyeViews views{Stereo::Single, {}, {}};
+    for (auto i = 0; i < 16; i += 5)
+    {
+        views.projection[0][i] = views.modelview[0][i] = 1.0f;
+    }
+    glViewport(0, 0, kStampWidth, kStampHeight);
+    glClearColor(0, 0, 0, 1);
+
+    auto epoch = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+    // worker talks to X on its own thread, own connection for it
+    auto workerDpy = connect(opt.display);
+    std::vector<uint64_t> latencyUs;
+    size_t missed{0};
+    size_t stale{0};
+    {
+        LatencyMirror mirror(workerDpy, source);
+        InstanceBatch batch;
+        WindowCapture readBack(dpy, WindowCapture::GET_IMAGE);
+        std::vector<uint8_t> shownPixels;
+        uint64_t last{0};
+        auto end = std::chrono::steady_clock::now() + std::chrono::seconds(opt.seconds);
+        while (std::chrono::steady_clock::now() < end)
+        {
+            auto stamp = stampNow(epoch);
+            if (stamp == last)
+            {
+                continue;
+            }
+            paintStamp(dpy, source, gc, stamp);
+            if (!mirror.update())
+            {
+                ++missed;
+                continue;
+            }
+            batch.clear();
+            batch.add(mirror.instance(), mirror.texture());
+            glClear(GL_COLOR_BUFFER_BIT);
+            batch.draw(views);
+            SDL_GL_SwapWindow(window);
+
+            // displayed once server has it in the window, not when swap returns
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            for (;;)
+            {
+                auto seen = readStamp(dpy, shown, readBack, shownPixels);
+                if (seen == stamp)
+                {
+                    latencyUs.push_back(stampNow(epoch) - stamp);
+                    break;
+                }
+                if (std::chrono::steady_clock::now() > deadline)
+                {
+                    if (seen == last && last != 0)
+                    {
+                        // previous capture still on screen, upload lags a frame
+                        ++stale;
+                    }else
+                    {
+                        ++missed;
+                    }
+                    break;
+                }
+            }
+            last = stamp;
+        }
+    }
+
+    XCloseDisplay(workerDpy);
+    SDL_GL_DeleteContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    XFreeGC(dpy, gc);
+    XDestroyWindow(dpy, source);
+
+    if (latencyUs.empty())
+    {
+        printf("no timestamp reached the display\n");
+        return 1;
+    }
+    std::sort(latencyUs.begin(), latencyUs.end());
+    printf("%-10s %10s %10s %10s %10s %10s %10s %10s\n",
+           "", "frames", "missed", "stale", "p50 us", "p90 us", "p99 us", "max us");
+    printf("%-10s %10zu %10zu %10zu %10lu %10lu %10lu %10lu\n", "latency", latencyUs.size(), missed, stale,
+           percentile(latencyUs, 0.5), percentile(latencyUs, 0.9), percentile(latencyUs, 0.99),
+           latencyUs.back());
+    if (missed > 0 || stale > 0 || percentile(latencyUs, 0.9) > opt.maxLatencyMs * 1000)
+    {
+        printf("capture to display above %.1f ms or frames lost\n", opt.maxLatencyMs);
+        return 1;
+    }
+    return 0;
+}
+
+// every converter on random pixels, scalar against simd
+static int benchConvert(const Options& opt)
+{
+    auto size = opt.sizes.front();
+    auto width = static_cast<int>(size.width);
+    auto height = static_cast<int>(size.height);
+    // rows padded like XImage for widest format, slack for vector tails
+    auto maxStride = (size_t(width) * 4 + 31) & ~size_t(31);
+    std::vector<uint8_t> in(maxStride * height + 64);
+    std::mt19937 rnd(1);
+    for (auto& byte : in)
+    {
+        byte = rnd();
+    }
+    std::vector<uint8_t> scalarOut(size_t(width) * height * 4);
+    std::vector<uint8_t> simdOut(scalarOut.size());
+
+    auto exitCode{0};
+    printf("%dx%d\n", width, height);
+    printf("%-10s %-7s %12s %10s\n", "format", "path", "MPix/s", "MB/s out");
+    for (auto format : {PIXEL_FORMAT_BGRX8888, PIXEL_FORMAT_BGR888,
+                        PIXEL_FORMAT_RGB565, PIXEL_FORMAT_RGB555})
+    {
+        size_t bpp = format == PIXEL_FORMAT_BGRX8888 ? 4 : (format == PIXEL_FORMAT_BGR888 ? 3 : 2);
+        // odd stride like XImage padding
+        auto stride = (width * bpp + 31) & ~size_t(31);
+        for (auto simd : {false, true})
+        {
+            auto& out = simd ? simdOut : scalarOut;
+            size_t frames{0};
+            auto start = std::chrono::steady_clock::now();
+            auto end = start + std::chrono::seconds(opt.seconds);
+            for (; std::chrono::steady_clock::now() < end; ++frames)
+            {
+                convertPixels(format, in.data(), stride, out.data(), width, height, 128, simd);
+            }
+            auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            auto pixels = double(frames) * width * height;
+            printf("%-10s %-7s %12.1f %10.1f\n", pixelFormatName(format), simd ? "simd" : "scalar",
+                   pixels / seconds / 1e6, pixels * 4 / seconds / (1 << 20));
+        }
+        if (scalarOut != simdOut)
+        {
+            printf("%s simd output differs from scalar\n", pixelFormatName(format));
+            exitCode = 1;
+        }
+    }
+
+    // windows in background are kept RGB565
+    std::vector<uint8_t> scalar565(size_t(width) * height * 2);
+    std::vector<uint8_t> simd565(scalar565.size());
+    for (auto simd : {false, true})
+    {
+        auto& out = simd ? simd565 : scalar565;
+        size_t frames{0};
+        auto start = std::chrono::steady_clock::now();
+        auto end = start + std::chrono::seconds(opt.seconds);
+        for (; std::chrono::steady_clock::now() < end; ++frames)
+        {
+            packRgb565(in.data(), out.data(), size_t(width) * height, simd);
+        }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto pixels = double(frames) * width * height;
+        printf("%-10s %-7s %12.1f %10.1f\n", "to rgb565", simd ? "simd" : "scalar",
+               pixels / seconds / 1e6, pixels * 2 / seconds / (1 << 20));
+    }
+    if (scalar565 != simd565)
+    {
+        printf("rgb565 simd output differs from scalar\n");
+        exitCode = 1;
+    }
+
+    // static windows are BC1 encoded on idle priority encode thread
+    std::vector<uint8_t> scalarBc1(bc1Size(width, height));
+    std::vector<uint8_t> simdBc1(scalarBc1.size());
+    for (auto simd : {false, true})
+    {
+        auto& out = simd ? simdBc1 : scalarBc1;
+        size_t frames{0};
+        auto start = std::chrono::steady_clock::now();
+        auto end = start + std::chrono::seconds(opt.seconds);
+        for (; std::chrono::steady_clock::now() < end; ++frames)
+        {
+            compressBc1(in.data(), width, height, out.data(), simd);
+        }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto pixels = double(frames) * width * height;
+        printf("%-10s %-7s %12.1f %10.1f\n", "BC1", simd ? "simd" : "scalar",
+               pixels / seconds / 1e6, pixels / 2 / seconds / (1 << 20));
+    }
+    if (scalarBc1 != simdBc1)
+    {
+        printf("BC1 simd output differs from scalar\n");
+        exitCode = 1;
+    }
+    return exitCode;
+}
+
+// animated windows captured by every backend
+static int benchCapture(const Options& opt, Display* dpy)
+{
+    auto exitCode{0};
+    auto root = DefaultRootWindow(dpy);
+
+    std::vector<Window> windows;
+    std::vector<Size> sizes;
+    for (size_t i = 0; i < opt.windows; ++i)
+    {
+        auto size = opt.sizes[i % opt.sizes.size()];
+        windows.push_back(XCreateSimpleWindow(dpy, root, (i * 37) % 1920, (i * 23) % 1080,
+                                              size.width, size.height, 0, 0, 0));
+        sizes.push_back(size);
+        XMapWindow(dpy, windows.back());
+    }
+    XSync(dpy, False);
+
+    std::atomic<bool> exit{false};
+    std::thread animator(animate, opt.display, windows, sizes, &exit);
+
+    std::unique_ptr<CaptureRecorder> recorder;
+    if (!opt.trace.empty())
+    {
+        recorder = std::make_unique<CaptureRecorder>(opt.trace);
+    }
+
+    printf("%zu windows, %d s per backend\n", windows.size(), opt.seconds);
+    printf("%-10s %12s %10s %10s %10s %10s %10s\n",
+           "backend", "captures/s", "MB/s", "p50 us", "p90 us", "p99 us", "max us");
+    for (auto backend : {WindowCapture::GET_IMAGE, WindowCapture::SHM})
+    {
+        auto result = runBackend(dpy, backend, windows, opt.seconds,
+                                 backend == WindowCapture::SHM ? recorder.get() : nullptr);
+        if (result.captures == 0)
+        {
+            printf("%-10s %12s\n", WindowCapture::name(backend), "unavailable");
+            continue;
+        }
+        std::sort(result.latencyUs.begin(), result.latencyUs.end());
+        auto rate = result.captures / result.seconds;
+        printf("%-10s %12.1f %10.1f %10lu %10lu %10lu %10lu\n",
+               WindowCapture::name(backend), rate,
+               result.bytes / result.seconds / (1 << 20),
+               percentile(result.latencyUs, 0.5),
+               percentile(result.latencyUs, 0.9),
+               percentile(result.latencyUs, 0.99),
+               result.latencyUs.back());
+        if (rate < opt.minRate)
+        {
+            printf("%s below minimum rate %.1f\n", WindowCapture::name(backend), opt.minRate);
+            exitCode = 1;
+        }
+    }
+
+    exit = true;
+    animator.join();
+    recorder.reset();
+    return exitCode;
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    try
+    {
+        opt = parseOptions(argc, argv);
+    } catch (const std::exception& e)
+    {
+        std::cout << "ERROR: " << e.what() << "\n";
+        return 2;
+    } catch (const Error& e)
+    {
+        std::cout << "ERROR: " << e.mMsg << "\n";
+        return 2;
+    }
+
+    if (opt.convert)
+    {
+        return benchConvert(opt);
+    }
+
+    pid_t xvfb{-1};
+    if (opt.startXvfb)
+    {
+        xvfb = startXvfb(opt.display, opt.depth);
+    }
+
+    auto exitCode{0};
+    try
+    {
+        XInitThreads();
+        auto dpy = connect(opt.display);
+        exitCode = opt.latency ? benchLatency(opt, dpy) : benchCapture(opt, dpy);
+        XCloseDisplay(dpy);
+    } catch (const Error& e)
+    {
+        std::cout << "ERROR: " << e.mMsg << "\n";
+        exitCode = 2;
+    }
+
+    if (xvfb > 0)
+    {
+        kill(xvfb, SIGTERM);
+        waitpid(xvfb, nullptr, 0);
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,133 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+#include <iostream>
+
+#include "CaptureFile.h"
+#include "TypesConf.h"
+
+static int64_t nowUs()
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
+}
+
+static size_t padTo8(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+CaptureRecorder::CaptureRecorder(const std::string& fileName)
+    : mFile{fopen(fileName.c_str(), "wb")},
+      mFrameCount{0},
+      mFirstTimestampUs{-1}
+{
+    if (mFile == nullptr)
+    {
+        throw Error("Unable to create capture file " + fileName);
+    }
+    CaptureFileHeader header;
+    memcpy(header.magic, kCaptureMagic, sizeof(header.magic));
+    header.version = kCaptureVersion;
+    header.headerSize = sizeof(CaptureFileHeader);
+    header.frameCount = 0;
+    fwrite(&header, sizeof(header), 1, mFile);
+}
+
+CaptureRecorder::~CaptureRecorder()
+{
+    // frame count is known only now
+    fseek(mFile, offsetof(CaptureFileHeader, frameCount), SEEK_SET);
+    fwrite(&mFrameCount, sizeof(mFrameCount), 1, mFile);
+    fclose(mFile);
+    logi_ << "recorded " << mFrameCount << " frames\n";
+}
+
+void CaptureRecorder::write(uint64_t window, uint32_t cycle, uint32_t width,
+                            uint32_t height, const uint8_t* pixels)
+{
+    auto now = nowUs();
+    if (mFirstTimestampUs < 0)
+    {
+        mFirstTimestampUs = now;
+    }
+
+    CaptureFrameHeader frame;
+    frame.timestampUs = now - mFirstTimestampUs;
+    frame.window = window;
+    frame.cycle = cycle;
+    frame.format = CAPTURE_FORMAT_BGRA8;
+    frame.width = width;
+    frame.height = height;
+    // no damage tracking yet, whole window is dirty
+    frame.damageX = 0;
+    frame.damageY = 0;
+    frame.damageWidth = width;
+    frame.damageHeight = height;
+    frame.payloadSize = size_t(width) * height * 4;
+
+    static const uint8_t padding[8] = {0};
+    fwrite(&frame, sizeof(frame), 1, mFile);
+    fwrite(pixels, frame.payloadSize, 1, mFile);
+    fwrite(padding, padTo8(frame.payloadSize) - frame.payloadSize, 1, mFile);
+    ++mFrameCount;
+}
+
+CaptureReplay::CaptureReplay(const std::string& fileName)
+    : mData{nullptr},
+      mSize{0}
+{
+    auto fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw Error("Unable to open capture file " + fileName);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(CaptureFileHeader))
+    {
+        close(fd);
+        throw Error("Capture file too short " + fileName);
+    }
+    mSize = st.st_size;
+    auto data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        throw Error("Unable to map capture file " + fileName);
+    }
+    mData = static_cast<const uint8_t*>(data);
+    madvise(data, mSize, MADV_SEQUENTIAL);
+
+    auto header = reinterpret_cast<const CaptureFileHeader*>(mData);
+    if (memcmp(header->magic, kCaptureMagic, sizeof(header->magic)) != 0 ||
+        header->version != kCaptureVersion)
+    {
+        munmap(data, mSize);
+        throw Error("Not a capture file " + fileName);
+    }
+
+    // index frames, an unfinished recording still has valid frames
+    auto offset = size_t(header->headerSize);
+    while (offset + sizeof(CaptureFrameHeader) <= mSize)
+    {
+        auto frame = reinterpret_cast<const CaptureFrameHeader*>(mData + offset);
+        auto next = offset + sizeof(CaptureFrameHeader) + padTo8(frame->payloadSize);
+        if (next > mSize)
+        {
+            break;
+        }
+        mFrames.push_back(offset);
+        offset = next;
+    }
+    logi_ << "capture file " << fileName << " has " << mFrames.size() << " frames\n";
+}
+
+CaptureReplay::~CaptureReplay()
+{
+    munmap(const_cast<uint8_t*>(mData), mSize);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On disk layout of recorded mirror captures. All records are 8 byte aligned
+// so a mmap'ed file can be consumed in place:
+//   CaptureFileHeader
+//   { CaptureFrameHeader, payload, padding to 8 bytes } * frameCount
+static const char kCaptureMagic[8] = {'X', 'M', 'R', 'C', 'A', 'P', 0, 0};
+static const uint32_t kCaptureVersion = 1;
+
+enum CaptureFormat : uint32_t
+{
+    CAPTURE_FORMAT_BGRA8 = 0
+};
+
+struct CaptureFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t frameCount;
+};
+
+struct CaptureFrameHeader
+{
+    uint64_t timestampUs;  // since first frame
+    uint64_t window;
+    uint32_t cycle;        // frames of one capture cycle share it
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    int32_t damageX;
+    int32_t damageY;
+    uint32_t damageWidth;
+    uint32_t damageHeight;
+    uint64_t payloadSize;
+};
+
+static_assert(sizeof(CaptureFileHeader) % 8 == 0, "header not aligned");
+static_assert(sizeof(CaptureFrameHeader) % 8 == 0, "frame header not aligned");
+
+class CaptureRecorder
+{
+public:
+    CaptureRecorder(const std::string& fileName);
+    ~CaptureRecorder();
+
+    void write(uint64_t window, uint32_t cycle, uint32_t width, uint32_t height,
+               const uint8_t* pixels);
+
+private:
+    FILE* mFile;
+    uint64_t mFrameCount;
+    int64_t mFirstTimestampUs;
+};
+
+class CaptureReplay
+{
+public:
+    CaptureReplay(const std::string& fileName);
+    ~CaptureReplay();
+
+    size_t size() const { return mFrames.size(); }
+    const CaptureFrameHeader& frame(size_t i) const
+    {
+        return *reinterpret_cast<const CaptureFrameHeader*>(mData + mFrames[i]);
+    }
+    const uint8_t* payload(size_t i) const
+    {
+        return mData + mFrames[i] + sizeof(CaptureFrameHeader);
+    }
+
+private:
+    const uint8_t* mData;
+    size_t mSize;
+    std::vector<size_t> mFrames;  // offsets of frame headers
+};
@@ -4,18 +4,20 @@
 #include <thread>
 #include <string>
 #include <map>
+#include <mutex>
 
 #include <SDL2/SDL.h>
 #include <GL/gl.h>
 
 #include "TypesConf.h"
+#include "VertexBatch.h"
 
 class RenderingEngine;
 class Client
 {
 public:
     Client()
-        : mGenerateSceneEventId{SDL_RegisterEvents(1)}
+        : mGenerateSceneEventId{registerEvent()}
     {
     
     }
@@ -49,6 +51,14 @@ public:
         (void)y;
     }
     
+    // opengl thread, once per frame before events are handled
+    virtual void frameStart(cl_float4& whereami, cl_float4& lookat, RenderingEngine* renderingEngine)
+    {
+        (void)whereami;
+        (void)lookat;
+        (void)renderingEngine;
+    }
+
     virtual void handleEvents(SDL_Event& event)
     {
         (void)event;
@@ -62,15 +72,25 @@ public:
         return mGenerateSceneEventId;
     }
 
-    virtual std::experimental::optional<GLuint> getList() const
+    // opengl thread, puts client's part of scene into bound framebuffer,
+    // both eyes at once unless views are single
+    virtual void draw(const EyeViews& views)
     {
-        return mList;
+        mBatch.draw(views);
     }
     
 protected:    
+    // clients may be constructed in parallel at startup
+    static Uint32 registerEvent()
+    {
+        static std::mutex mtx;
+        std::lock_guard<std::mutex> lock(mtx);
+        return SDL_RegisterEvents(1);
+    }
+
     std::unique_ptr<std::thread> mThread;
     
-    std::experimental::optional<GLuint> mList;
+    VertexBatch mBatch;
     Uint32 mGenerateSceneEventId;
 
     std::map<std::string, bool> mRenderedItems;
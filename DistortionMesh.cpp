@@ -0,0 +1,245 @@
+#include <math.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "DistortionMesh.h"
+#include "OpenGlWrap.h"
+
+namespace
+{
+
+// cells per eye side, fine enough that straight edges between vertices
+// are not visible through the lens
+const int kCells = 48;
+const int kEyeVertices = (kCells + 1) * (kCells + 1);
+const int kEyeIndices = kCells * kCells * 6;
+
+const char* kVertexShader = R"(#version 330
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 red;
+layout(location = 2) in vec2 green;
+layout(location = 3) in vec2 blue;
+uniform mat3 reproject;
+out vec3 redAt;
+out vec3 greenAt;
+out vec3 blueAt;
+// homogeneous, divided per pixel so reprojection stays exact
+vec3 toImage(vec2 tc)
+{
+    return reproject * vec3(tc * 2.0 - 1.0, 1.0);
+}
+void main()
+{
+    redAt = toImage(red);
+    greenAt = toImage(green);
+    blueAt = toImage(blue);
+    gl_Position = vec4(position, 0.0, 1.0);
+}
+)";
+
+// after a prologue defining IMAGE, sampler type, and SAMPLE(uv)
+const char* kFragmentShader = R"(
+uniform IMAGE image;
+uniform float layer;
+in vec3 redAt;
+in vec3 greenAt;
+in vec3 blueAt;
+out vec4 fragColor;
+vec2 uv(vec3 p)
+{
+    return p.xy / p.z * 0.5 + 0.5;
+}
+void main()
+{
+    vec2 g = uv(greenAt);
+    // black edges off the image
+    if (greenAt.z <= 0.0 || any(lessThan(g, vec2(0.0))) || any(greaterThan(g, vec2(1.0))))
+    {
+        fragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+    fragColor = vec4(SAMPLE(uv(redAt)).r, SAMPLE(g).g, SAMPLE(uv(blueAt)).b, 1.0);
+}
+)";
+
+}
+
+DistortionMesh::DistortionMesh()
+    : mLens{},
+      mBuilt{false, false},
+      mBuilds{0},
+      mPrograms{},
+      mVao{0},
+      mVertices{0},
+      mIndices{0}
+{
+}
+
+void DistortionMesh::create()
+{
+    const char* prologues[2] = {"#version 330\n"
+                                "#define IMAGE sampler2D\n"
+                                "#define SAMPLE(uv) texture(image, uv)\n",
+                                "#version 330\n"
+                                "#define IMAGE sampler2DArray\n"
+                                "#define SAMPLE(uv) texture(image, vec3(uv, layer))\n"};
+    for (auto i = 0; i < 2; ++i)
+    {
+        auto& program = mPrograms[i];
+        auto fragment = std::string(prologues[i]) + kFragmentShader;
+        program.name = OpenGlWrap::compileShaders(kVertexShader, fragment.c_str());
+        program.reproject = glGetUniformLocation(program.name, "reproject");
+        program.layer = glGetUniformLocation(program.name, "layer");
+        glUseProgram(program.name);
+        glUniform1i(glGetUniformLocation(program.name, "image"), 0);
+        glUseProgram(0);
+    }
+
+    // same triangles for both eyes, second eye by base vertex
+    std::vector<GLushort> indices;
+    for (auto y = 0; y < kCells; ++y)
+    {
+        for (auto x = 0; x < kCells; ++x)
+        {
+            GLushort ld = y * (kCells + 1) + x;
+            GLushort rd = ld + 1;
+            GLushort lu = ld + kCells + 1;
+            GLushort ru = lu + 1;
+            for (auto index : {lu, ld, rd, lu, rd, ru})
+            {
+                indices.push_back(index);
+            }
+        }
+    }
+
+    glGenVertexArrays(1, &mVao);
+    glGenBuffers(1, &mVertices);
+    glGenBuffers(1, &mIndices);
+    glBindVertexArray(mVao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, mVertices);
+    glBufferData(GL_ARRAY_BUFFER, 2 * kEyeVertices * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, x)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, red)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, green)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, blue)));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DistortionMesh::update(int eye, const Lens& lens)
+{
+    // plain floats, bytes tell if anything moved
+    if (mBuilt[eye] && memcmp(&mLens[eye], &lens, sizeof(Lens)) == 0)
+    {
+        return;
+    }
+    if (mVao == 0)
+    {
+        create();
+    }
+
+    std::vector<Vertex> vertices;
+    vertices.reserve(kEyeVertices);
+    for (auto y = 0; y <= kCells; ++y)
+    {
+        for (auto x = 0; x <= kCells; ++x)
+        {
+            // where on eye half of screen, 0 to 1
+            float s = static_cast<float>(x) / kCells;
+            float t = static_cast<float>(y) / kCells;
+            Vertex vertex;
+            vertex.x = eye == 0 ? s - 1.0f : s;
+            vertex.y = t * 2.0f - 1.0f;
+
+            // lens centered at world scale, radius 1 at warpScale
+            float r[2] = {(s * lens.viewportScale[0] - lens.center[0]) / lens.warpScale,
+                          (t * lens.viewportScale[1] - lens.center[1]) / lens.warpScale};
+            auto rMag = sqrtf(r[0] * r[0] + r[1] * r[1]);
+            auto& k = lens.coeffs;
+            auto scale = (k[3] + k[2] * rMag + k[1] * rMag * rMag + k[0] * rMag * rMag * rMag) * lens.warpScale;
+            GLfloat* channels[3] = {vertex.red, vertex.green, vertex.blue};
+            for (auto c = 0; c < 3; ++c)
+            {
+                channels[c][0] = (lens.center[0] + lens.aberr[c] * r[0] * scale) / lens.viewportScale[0];
+                channels[c][1] = (lens.center[1] + lens.aberr[c] * r[1] * scale) / lens.viewportScale[1];
+            }
+            vertices.push_back(vertex);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mVertices);
+    glBufferSubData(GL_ARRAY_BUFFER, eye * kEyeVertices * sizeof(Vertex), kEyeVertices * sizeof(Vertex),
+                    vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mLens[eye] = lens;
+    mBuilt[eye] = true;
+    ++mBuilds;
+}
+
+void DistortionMesh::draw(int eye, GLenum target, GLuint texture, const GLfloat reproject[9])
+{
+    if (!mBuilt[eye])
+    {
+        return;
+    }
+    auto& program = mPrograms[target == GL_TEXTURE_2D_ARRAY ? 1 : 0];
+    glUseProgram(program.name);
+    glUniformMatrix3fv(program.reproject, 1, GL_FALSE, reproject);
+    glUniform1f(program.layer, eye);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(target, texture);
+    glBindVertexArray(mVao);
+    glDrawElementsBaseVertex(GL_TRIANGLES, kEyeIndices, GL_UNSIGNED_SHORT, nullptr, eye * kEyeVertices);
+    glBindVertexArray(0);
+    glBindTexture(target, 0);
+    glUseProgram(0);
+}
+
+void DistortionMesh::reprojection(const GLfloat* projection, const cl_float4& delta, GLfloat out[9])
+{
+    const float k[3][3] = {{projection[0], projection[4], projection[8]},
+                           {projection[1], projection[5], projection[9]},
+                           {projection[3], projection[7], projection[11]}};
+    auto det = k[0][0] * (k[1][1] * k[2][2] - k[1][2] * k[2][1]) -
+               k[0][1] * (k[1][0] * k[2][2] - k[1][2] * k[2][0]) +
+               k[0][2] * (k[1][0] * k[2][1] - k[1][1] * k[2][0]);
+    float inv[3][3];
+    for (auto i = 0; i < 3; ++i)
+    {
+        for (auto j = 0; j < 3; ++j)
+        {
+            // cofactor of k[j][i]
+            auto a = (j + 1) % 3, b = (j + 2) % 3, c = (i + 1) % 3, d = (i + 2) % 3;
+            inv[i][j] = (k[a][c] * k[b][d] - k[a][d] * k[b][c]) / det;
+        }
+    }
+    auto& q = delta;
+    const float r[3][3] = {{1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y - q.w * q.z), 2 * (q.x * q.z + q.w * q.y)},
+                           {2 * (q.x * q.y + q.w * q.z), 1 - 2 * (q.x * q.x + q.z * q.z), 2 * (q.y * q.z - q.w * q.x)},
+                           {2 * (q.x * q.z - q.w * q.y), 2 * (q.y * q.z + q.w * q.x), 1 - 2 * (q.x * q.x + q.y * q.y)}};
+    float kr[3][3];
+    for (auto i = 0; i < 3; ++i)
+    {
+        for (auto j = 0; j < 3; ++j)
+        {
+            kr[i][j] = k[i][0] * r[0][j] + k[i][1] * r[1][j] + k[i][2] * r[2][j];
+        }
+    }
+    for (auto i = 0; i < 3; ++i)
+    {
+        for (auto j = 0; j < 3; ++j)
+        {
+            out[j * 3 + i] = kr[i][0] * inv[0][j] + kr[i][1] * inv[1][j] + kr[i][2] * inv[2][j];
+        }
+    }
+}
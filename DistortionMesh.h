@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+
+#include <GL/gl.h>
+
+#include "TypesConf.h"
+
+// Lens distortion and chromatic aberration of both eyes as a grid of
+// vertices, each carrying where red, green and blue sample the eye image.
+// The distortion polynomial is evaluated per vertex when lens parameters
+// change instead of per pixel every frame; pixels only interpolate. The
+// eye image is also reprojected by head rotation since it was drawn.
+//
+// Opengl thread only. GL objects go with the context, they are not deleted
+// here.
+class DistortionMesh
+{
+public:
+    // what OpenHMD's universal distortion shader took as uniforms
+    struct Lens
+    {
+        // eye viewport and lens center in m
+        float viewportScale[2];
+        float center[2];
+        // m of distortion radius 1
+        float warpScale;
+        // PanoTools model a b c d
+        float coeffs[4];
+        // scale of red, green and blue displacement
+        float aberr[3];
+    };
+
+    DistortionMesh();
+
+    // rebuilds grid of eye (0 left, 1 right) if lens is not what it was
+    // built for
+    void update(int eye, const Lens& lens);
+    // eye image into its half of bound framebuffer; texture is 2D or 2D
+    // array with eye as layer; reproject maps ndc at latest pose to
+    // homogeneous ndc of image, 3x3 column major
+    void draw(int eye, GLenum target, GLuint texture, const GLfloat reproject[9]);
+    // grids built so far
+    size_t builds() const { return mBuilds; }
+
+    // K * R(delta) * K^-1, K the part of projection taking view direction
+    // to homogeneous ndc; reprojects image drawn at a pose to pose turned
+    // by delta
+    static void reprojection(const GLfloat* projection, const cl_float4& delta, GLfloat out[9]);
+
+private:
+    struct Vertex
+    {
+        GLfloat x, y;
+        GLfloat red[2];
+        GLfloat green[2];
+        GLfloat blue[2];
+    };
+    void create();
+
+    // for 2D and array eye textures
+    struct Program
+    {
+        GLuint name;
+        GLint reproject;
+        GLint layer;
+    };
+
+    Lens mLens[2];
+    bool mBuilt[2];
+    size_t mBuilds;
+    Program mPrograms[2];
+    GLuint mVao;
+    GLuint mVertices;
+    GLuint mIndices;
+};
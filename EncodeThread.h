@@ -0,0 +1,82 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "TypesConf.h"
+
+// Runs BC1 encodes of windows that stopped changing, one at a time, at idle
+// priority so capture workers and rendering never wait for them. Jobs run in
+// the order they were posted, ones not started yet are dropped on exit.
+class EncodeThread
+{
+public:
+    EncodeThread()
+        : mExit{false}
+    {
+        mThread = std::make_unique<std::thread>(&EncodeThread::thrFnc, this);
+    }
+
+    ~EncodeThread()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMtx);
+            mExit = true;
+        }
+        mCv.notify_one();
+        mThread->join();
+    }
+
+    void post(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMtx);
+            mJobs.push_back(std::move(job));
+        }
+        mCv.notify_one();
+    }
+
+private:
+    void thrFnc()
+    {
+        // only gets cpu nobody else wants, no privileges needed for it
+        sched_param param{};
+        if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0)
+        {
+            logw_ << "encode thread runs at normal priority\n";
+        }
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mMtx);
+                mCv.wait(lock, [this]() { return mExit || !mJobs.empty(); });
+                if (mExit)
+                {
+                    break;
+                }
+                job = std::move(mJobs.front());
+                mJobs.pop_front();
+            }
+            job();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mMtx);
+            mJobs.clear();
+        }
+        logi_ << "Encode thread exited\n";
+    }
+
+    bool mExit;
+    std::deque<std::function<void()>> mJobs;
+    std::mutex mMtx;
+    std::condition_variable mCv;
+    std::unique_ptr<std::thread> mThread;
+};
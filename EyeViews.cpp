@@ -0,0 +1,53 @@
+#include <GL/glew.h>
+
+#include "EyeViews.h"
+
+bool EyeViews::supported(Stereo stereo)
+{
+    switch (stereo)
+    {
+        case Stereo::Multiview:
+            return GLEW_OVR_multiview;
+        case Stereo::Instanced:
+            return GLEW_ARB_shader_viewport_layer_array;
+        default:
+            return true;
+    }
+}
+
+const char* EyeViews::name(Stereo stereo)
+{
+    switch (stereo)
+    {
+        case Stereo::Multiview:
+            return "multiview";
+        case Stereo::Instanced:
+            return "instanced";
+        default:
+            return "single";
+    }
+}
+
+std::string EyeViews::vertexPrologue(Stereo stereo)
+{
+    switch (stereo)
+    {
+        case Stereo::Multiview:
+            // OVR_multiview lets view id change gl_Position only, which is
+            // all that differs between eyes here
+            return "#version 330\n"
+                   "#extension GL_OVR_multiview : require\n"
+                   "layout(num_views = 2) in;\n"
+                   "#define EYE int(gl_ViewID_OVR)\n"
+                   "#define STEREO_LAYER\n";
+        case Stereo::Instanced:
+            return "#version 330\n"
+                   "#extension GL_ARB_shader_viewport_layer_array : require\n"
+                   "#define EYE (gl_InstanceID & 1)\n"
+                   "#define STEREO_LAYER gl_Layer = EYE;\n";
+        default:
+            return "#version 330\n"
+                   "#define EYE 0\n"
+                   "#define STEREO_LAYER\n";
+    }
+}
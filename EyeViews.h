@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include <GL/gl.h>
+
+// How batches put scene into eye images. Single draws one eye per pass, the
+// others rasterize both eyes into a 2 layer target from one submission.
+enum class Stereo
+{
+    Single,
+    // GL_OVR_multiview, driver replays each draw into both layers
+    Multiview,
+    // each draw instanced twice, vertex shader picks eye and layer
+    Instanced,
+};
+
+// Eyes a draw goes to, matrices column major like glLoadMatrixf. Single
+// uses index 0 only.
+struct EyeViews
+{
+    Stereo stereo;
+    GLfloat projection[2][16];
+    GLfloat modelview[2][16];
+
+    // true if driver can rasterize that way
+    static bool supported(Stereo stereo);
+    static const char* name(Stereo stereo);
+    // start of vertex shader: version, extensions, EYE - index of eye the
+    // vertex is for, and STEREO_LAYER; to put into main
+    static std::string vertexPrologue(Stereo stereo);
+
+    // instances of every draw per instance of scene
+    GLsizei copies() const
+    {
+        return stereo == Stereo::Instanced ? 2 : 1;
+    }
+};
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <string>
+
+#include <GL/glew.h>
+
+#include "InstanceBatch.h"
+#include "EyeViews.h"
+#include "OpenGlWrap.h"
+#include "VertexBatch.h"
+
+namespace
+{
+
+// after EyeViews::vertexPrologue
+const char* kVertexShader = R"(
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 halfSize;
+layout(location = 2) in vec4 rotation;
+layout(location = 3) in vec4 uvRect;
+layout(location = 4) in vec4 color;
+layout(location = 5) in float unit;
+uniform mat4 projection[2];
+uniform mat4 modelview[2];
+out vec2 uv;
+out vec4 tint;
+flat out int image;
+// lu ld rd, lu rd ru
+const vec2 corners[6] = vec2[6](vec2(-1, 1), vec2(-1, -1), vec2(1, -1), vec2(-1, 1), vec2(1, -1), vec2(1, 1));
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+void main()
+{
+    vec2 corner = corners[gl_VertexID];
+    vec3 local = vec3(corner * halfSize, -5.0);
+    gl_Position = projection[EYE] * modelview[EYE] * vec4(position + rotate(rotation, local), 1.0);
+    STEREO_LAYER
+    uv = vec2(corner.x < 0.0 ? uvRect.x : uvRect.z, corner.y > 0.0 ? uvRect.y : uvRect.w);
+    tint = color;
+    image = int(unit);
+}
+)";
+
+// sampler index must be constant, one case per unit; gradients are taken
+// outside of branch so mip selection stays defined
+std::string fragmentShader()
+{
+    std::string source = R"(#version 330
+uniform sampler2D images[)" + std::to_string(InstanceBatch::kUnits) + R"(];
+in vec2 uv;
+in vec4 tint;
+flat in int image;
+out vec4 fragColor;
+void main()
+{
+    vec2 dx = dFdx(uv);
+    vec2 dy = dFdy(uv);
+    vec4 texel = vec4(1.0);
+    switch (image)
+    {
+)";
+    for (size_t unit = 0; unit < InstanceBatch::kUnits; ++unit)
+    {
+        auto n = std::to_string(unit);
+        source += "    case " + n + ": texel = textureGrad(images[" + n + "], uv, dx, dy); break;\n";
+    }
+    source += R"(    }
+    fragColor = texel * tint;
+}
+)";
+    return source;
+}
+
+struct Program
+{
+    GLuint name;
+    GLint projection;
+    GLint modelview;
+};
+
+const Program& program(Stereo stereo)
+{
+    static Program programs[3]{};
+    auto& program = programs[static_cast<int>(stereo)];
+    if (program.name == 0)
+    {
+        auto vertex = EyeViews::vertexPrologue(stereo) + kVertexShader;
+        program.name = OpenGlWrap::compileShaders(vertex.c_str(), fragmentShader().c_str());
+        program.projection = glGetUniformLocation(program.name, "projection");
+        program.modelview = glGetUniformLocation(program.name, "modelview");
+        glUseProgram(program.name);
+        for (size_t unit = 0; unit < InstanceBatch::kUnits; ++unit)
+        {
+            auto name = "images[" + std::to_string(unit) + "]";
+            glUniform1i(glGetUniformLocation(program.name, name.c_str()), unit);
+        }
+        glUseProgram(0);
+    }
+    return program;
+}
+
+}
+
+bool InstanceBatch::supported()
+{
+    return GLEW_VERSION_3_3;
+}
+
+InstanceBatch::InstanceBatch()
+    : mDrawsDirty{false},
+      mDirtyFrom{std::numeric_limits<size_t>::max()},
+      mDirtyTo{0},
+      mVao{0},
+      mBuffer{0},
+      mCapacity{0}
+{
+}
+
+size_t InstanceBatch::add(const Instance& instance, GLuint texture)
+{
+    mInstances.push_back(instance);
+    mTextures.push_back(texture);
+    mDrawsDirty = true;
+    return mInstances.size() - 1;
+}
+
+void InstanceBatch::set(size_t slot, const Instance& instance, GLuint texture)
+{
+    auto unit = mInstances[slot].unit;
+    mInstances[slot] = instance;
+    mInstances[slot].unit = unit;
+    if (mTextures[slot] != texture)
+    {
+        mTextures[slot] = texture;
+        mDrawsDirty = true;
+    }
+    mDirtyFrom = std::min(mDirtyFrom, slot);
+    mDirtyTo = std::max(mDirtyTo, slot + 1);
+}
+
+void InstanceBatch::clear()
+{
+    mInstances.clear();
+    mTextures.clear();
+    mDraws.clear();
+    mDrawsDirty = false;
+    mDirtyFrom = std::numeric_limits<size_t>::max();
+    mDirtyTo = 0;
+}
+
+void InstanceBatch::upload()
+{
+    if (mDrawsDirty)
+    {
+        // next draw starts once a texture does not fit unit table
+        mDraws.clear();
+        for (size_t i = 0; i < mInstances.size(); ++i)
+        {
+            auto texture = mTextures[i] != 0 ? mTextures[i] : VertexBatch::whiteTexture();
+            size_t unit{kUnits};
+            if (!mDraws.empty())
+            {
+                auto& textures = mDraws.back().textures;
+                unit = std::find(textures.begin(), textures.end(), texture) - textures.begin();
+                if (unit == textures.size() && unit < kUnits)
+                {
+                    textures.push_back(texture);
+                }
+            }
+            if (unit >= kUnits)
+            {
+                mDraws.push_back(Draw{i, 0, {texture}});
+                unit = 0;
+            }
+            ++mDraws.back().count;
+            mInstances[i].unit = unit;
+        }
+        mDirtyFrom = 0;
+        mDirtyTo = mInstances.size();
+        mDrawsDirty = false;
+    }
+
+    if (mVao == 0)
+    {
+        glGenVertexArrays(1, &mVao);
+        glGenBuffers(1, &mBuffer);
+    }
+    glBindVertexArray(mVao);
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    if (mInstances.size() > mCapacity)
+    {
+        mCapacity = std::max<size_t>(mInstances.size() * 3 / 2, 64);
+        glBufferData(GL_ARRAY_BUFFER, mCapacity * sizeof(Instance), nullptr, GL_DYNAMIC_DRAW);
+        mDirtyFrom = 0;
+        mDirtyTo = mInstances.size();
+    }
+    mDirtyTo = std::min(mDirtyTo, mInstances.size());
+    if (mDirtyFrom < mDirtyTo)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, mDirtyFrom * sizeof(Instance), (mDirtyTo - mDirtyFrom) * sizeof(Instance),
+                        mInstances.data() + mDirtyFrom);
+    }
+    mDirtyFrom = std::numeric_limits<size_t>::max();
+    mDirtyTo = 0;
+}
+
+void InstanceBatch::draw(const EyeViews& views)
+{
+    if (mInstances.empty())
+    {
+        mDraws.clear();
+        return;
+    }
+    auto& shared = program(views.stereo);
+    upload();
+    glUseProgram(shared.name);
+    glUniformMatrix4fv(shared.projection, 2, GL_FALSE, views.projection[0]);
+    glUniformMatrix4fv(shared.modelview, 2, GL_FALSE, views.modelview[0]);
+    struct Attribute
+    {
+        GLint size;
+        size_t offset;
+    };
+    const Attribute attributes[] = {
+        {3, offsetof(Instance, position)},
+        {2, offsetof(Instance, halfWidth)},
+        {4, offsetof(Instance, rotation)},
+        {4, offsetof(Instance, uv)},
+        {4, offsetof(Instance, color)},
+        {1, offsetof(Instance, unit)},
+    };
+    for (GLuint i = 0; i < sizeof(attributes) / sizeof(attributes[0]); ++i)
+    {
+        // instanced stereo draws each quad for both eyes in a row
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, views.copies());
+    }
+    for (auto& draw : mDraws)
+    {
+        // no base instance before GL 4.2, point attributes at first one
+        for (GLuint i = 0; i < sizeof(attributes) / sizeof(attributes[0]); ++i)
+        {
+            glVertexAttribPointer(i, attributes[i].size, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                                  reinterpret_cast<void*>(draw.first * sizeof(Instance) + attributes[i].offset));
+        }
+        for (size_t unit = 0; unit < draw.textures.size(); ++unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, draw.textures[unit]);
+        }
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, draw.count * views.copies());
+    }
+    for (size_t unit = kUnits; unit-- > 0;)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
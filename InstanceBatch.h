@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/gl.h>
+
+#include "EyeViews.h"
+
+// Textured quads all of one shape, a window of given size at distance 5 in
+// front of a point and rotated, drawn instanced from one buffer of per quad
+// data. Quads get their texture from a table of texture units, so as long
+// as no more than kUnits different textures are in view everything is one
+// draw call; atlas pages keep that count low.
+//
+// Opengl thread only. GL objects go with the context, they are not deleted
+// here.
+class InstanceBatch
+{
+public:
+    struct Instance
+    {
+        // center, quad lies at (+-halfWidth, +-halfHeight, -5) around it
+        // turned by rotation
+        GLfloat position[3];
+        GLfloat halfWidth;
+        GLfloat halfHeight;
+        GLfloat rotation[4];
+        // texture part of top left and bottom right corner
+        GLfloat uv[4];
+        GLfloat color[4];
+        // filled in by batch
+        GLfloat unit;
+    };
+    // textures one draw can sample, GL 3.3 guarantees 16
+    static const size_t kUnits{16};
+
+    // true if driver has what instanced quads need
+    static bool supported();
+
+    InstanceBatch();
+
+    // texture 0 is plain color, returns slot
+    size_t add(const Instance& instance, GLuint texture);
+    void set(size_t slot, const Instance& instance, GLuint texture);
+    void clear();
+    size_t size() const { return mInstances.size(); }
+
+    void draw(const EyeViews& views);
+    // draw calls last draw() made
+    size_t draws() const { return mDraws.size(); }
+
+private:
+    struct Draw
+    {
+        size_t first;
+        size_t count;
+        std::vector<GLuint> textures;
+    };
+    void upload();
+
+    std::vector<Instance> mInstances;
+    std::vector<GLuint> mTextures;
+    std::vector<Draw> mDraws;
+    bool mDrawsDirty;
+    size_t mDirtyFrom;
+    size_t mDirtyTo;
+    GLuint mVao;
+    GLuint mBuffer;
+    size_t mCapacity;
+};
@@ -0,0 +1,153 @@
+#include <iostream>
+
+#include "MemoryBudget.h"
+#include "TypesConf.h"
+
+MemoryBudget::MemoryBudget(size_t cpuCeiling, size_t gpuCeiling)
+    : mCpuCeiling{cpuCeiling},
+      mGpuCeiling{gpuCeiling},
+      mCpuUsed{0},
+      mGpuUsed{0}
+{
+}
+
+void MemoryBudget::setCpu(Key key, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    auto& entry = mEntries[key];
+    mCpuUsed = mCpuUsed - entry.cpu + bytes;
+    entry.cpu = bytes;
+}
+
+void MemoryBudget::setGpu(Key key, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    auto& entry = mEntries[key];
+    mGpuUsed = mGpuUsed - entry.gpu + bytes;
+    entry.gpu = bytes;
+}
+
+void MemoryBudget::touch(Key key, bool focus, bool visible)
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    auto& entry = mEntries[key];
+    entry.focus = focus;
+    entry.visible = visible;
+    if (focus || visible)
+    {
+        entry.lastUse = std::chrono::steady_clock::now();
+    }
+}
+
+void MemoryBudget::remove(Key key)
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    auto it = mEntries.find(key);
+    if (it == mEntries.end())
+    {
+        return;
+    }
+    mCpuUsed -= it->second.cpu;
+    mGpuUsed -= it->second.gpu;
+    mEntries.erase(it);
+}
+
+bool MemoryBudget::evictsBefore(const Entry& a, const Entry& b)
+{
+    if (a.visible != b.visible)
+    {
+        return !a.visible;
+    }
+    // visible ones are all used right now, prefer the largest of them
+    if (!a.visible && a.lastUse != b.lastUse)
+    {
+        return a.lastUse < b.lastUse;
+    }
+    return (a.cpu + a.gpu) > (b.cpu + b.gpu);
+}
+
+std::vector<MemoryBudget::Key> MemoryBudget::selectVictims()
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    // memory of already evicted entries is about to be released
+    auto cpu{mCpuUsed};
+    auto gpu{mGpuUsed};
+    for (auto& entry : mEntries)
+    {
+        if (entry.second.evicted)
+        {
+            cpu -= entry.second.cpu;
+            gpu -= entry.second.gpu;
+        }
+    }
+
+    std::vector<Key> victims;
+    while (cpu > mCpuCeiling || gpu > mGpuCeiling)
+    {
+        auto victim = mEntries.end();
+        for (auto it = mEntries.begin(); it != mEntries.end(); ++it)
+        {
+            // focused window is never evicted
+            if (it->second.evicted || it->second.focus ||
+                (it->second.cpu + it->second.gpu) == 0)
+            {
+                continue;
+            }
+            if (victim == mEntries.end() || evictsBefore(it->second, victim->second))
+            {
+                victim = it;
+            }
+        }
+        if (victim == mEntries.end())
+        {
+            break;
+        }
+        victim->second.evicted = true;
+        cpu -= victim->second.cpu;
+        gpu -= victim->second.gpu;
+        victims.push_back(victim->first);
+        logi_ << "evicting " << victim->first << " cpu " << victim->second.cpu << " gpu " << victim->second.gpu << "\n";
+    }
+
+    return victims;
+}
+
+bool MemoryBudget::readmit(Key key, size_t cpu, size_t gpu)
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    auto it = mEntries.find(key);
+    if (it == mEntries.end() || !it->second.evicted)
+    {
+        return true;
+    }
+    if (mCpuUsed + cpu > mCpuCeiling || mGpuUsed + gpu > mGpuCeiling)
+    {
+        return false;
+    }
+    it->second.evicted = false;
+    it->second.lastUse = std::chrono::steady_clock::now();
+    return true;
+}
+
+size_t MemoryBudget::cpuUsed() const
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    return mCpuUsed;
+}
+
+size_t MemoryBudget::gpuUsed() const
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    return mGpuUsed;
+}
+
+size_t MemoryBudget::evictedCount() const
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    size_t count{0};
+    for (auto& entry : mEntries)
+    {
+        count += entry.second.evicted ? 1 : 0;
+    }
+    return count;
+}
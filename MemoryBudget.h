@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Accounts CPU frame buffers and GL objects owned by mirrors and picks
+// eviction victims whenever the configured ceilings are exceeded.
+class MemoryBudget
+{
+public:
+    typedef const void* Key;
+
+    MemoryBudget(size_t cpuCeiling, size_t gpuCeiling);
+
+    void setCpu(Key key, size_t bytes);
+    void setGpu(Key key, size_t bytes);
+    // mark entry as used and refresh its priority inputs
+    void touch(Key key, bool focus, bool visible);
+    void remove(Key key);
+
+    // entries that must give up their memory, lowest priority first
+    std::vector<Key> selectVictims();
+    // true if evicted entry may come back with given estimated footprint
+    bool readmit(Key key, size_t cpu, size_t gpu);
+
+    size_t cpuUsed() const;
+    size_t gpuUsed() const;
+    size_t cpuCeiling() const { return mCpuCeiling; }
+    size_t gpuCeiling() const { return mGpuCeiling; }
+    size_t evictedCount() const;
+
+private:
+    struct Entry
+    {
+        size_t cpu{0};
+        size_t gpu{0};
+        bool focus{false};
+        bool visible{true};
+        bool evicted{false};
+        std::chrono::steady_clock::time_point lastUse{std::chrono::steady_clock::now()};
+    };
+    // true if a should be evicted before b: hidden before visible, least
+    // recently used and then largest first
+    static bool evictsBefore(const Entry& a, const Entry& b);
+
+    size_t mCpuCeiling;
+    size_t mGpuCeiling;
+    size_t mCpuUsed;
+    size_t mGpuUsed;
+    std::map<Key, Entry> mEntries;
+    mutable std::mutex mMtx;
+};
@@ -10,7 +10,10 @@ OpenGlWrap::OpenGlWrap(int w, int h)
       left_fbo{0},
       right_color_tex{0},
       right_depth_tex{0},
-      right_fbo{0}
+      right_fbo{0},
+      stereo_color_tex{0},
+      stereo_depth_tex{0},
+      stereo_fbo{0}
 {
 	if(SDL_Init(SDL_INIT_EVERYTHING) < 0)
     {
@@ -38,6 +41,16 @@ OpenGlWrap::OpenGlWrap(int w, int h)
 
 	SDL_GL_SetSwapInterval(1);
 
+	// second context on hidden window for the upload thread
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+	GlCtx.uploadWindow = SDL_CreateWindow("upload", 0, 0, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	GlCtx.uploadContext = GlCtx.uploadWindow ? SDL_GL_CreateContext(GlCtx.uploadWindow) : nullptr;
+	if (GlCtx.uploadContext == nullptr)
+	{
+		logw_ << "no shared context, uploads stay on render thread\n";
+	}
+	SDL_GL_MakeCurrent(GlCtx.window, GlCtx.glcontext);
+
 	// Load extensions.
 	glewInit();
 
@@ -68,7 +81,15 @@ OpenGlWrap::~OpenGlWrap()
 {
     deleteFbo(&left_fbo, &left_color_tex, &left_depth_tex);
     deleteFbo(&right_fbo, &right_color_tex, &right_depth_tex);
-    glDeleteProgram(shader);
+    deleteFbo(&stereo_fbo, &stereo_color_tex, &stereo_depth_tex);
+    if (GlCtx.uploadContext != nullptr)
+    {
+        SDL_GL_DeleteContext(GlCtx.uploadContext);
+    }
+    if (GlCtx.uploadWindow != nullptr)
+    {
+        SDL_DestroyWindow(GlCtx.uploadWindow);
+    }
     SDL_GL_DeleteContext(GlCtx.glcontext);  
     SDL_DestroyWindow(GlCtx.window);
     SDL_Quit();
@@ -167,6 +188,46 @@ void OpenGlWrap::createFbo(int eye_width, int eye_height, GLuint* fbo,
     glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
 }
 
+void OpenGlWrap::createStereoFbo(int eye_width, int eye_height, bool multiview, GLuint* fbo,
+                                 GLuint* color_tex, GLuint* depth_tex)
+{
+    glGenTextures(1, color_tex);
+    glGenTextures(1, depth_tex);
+    glGenFramebuffers(1, fbo);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, *color_tex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, eye_width, eye_height, 2, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, *depth_tex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, eye_width, eye_height, 2, 0,
+                 GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, *fbo);
+    if (multiview)
+    {
+        glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, *color_tex, 0, 0, 2);
+        glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, *depth_tex, 0, 0, 2);
+    } else
+    {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, *color_tex, 0);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, *depth_tex, 0);
+    }
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        throw Error("failed to create stereo fbo");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 void OpenGlWrap::deleteFbo(GLuint* fbo, GLuint* color_tex, GLuint* depth_tex)
 {
     glDeleteFramebuffers(1, fbo);
@@ -7,6 +7,9 @@ typedef struct
     int w, h;
     SDL_Window* window;
     SDL_GLContext glcontext;
+    // shares objects with glcontext, for upload thread, nullptr if unavailable
+    SDL_Window* uploadWindow;
+    SDL_GLContext uploadContext;
 } gl_ctx;
 
 class OpenGlWrap
@@ -16,19 +19,26 @@ public:
     
     virtual ~OpenGlWrap();
 
-    GLuint compileShaders(const char* vertex, const char* fragment);
+    static GLuint compileShaders(const char* vertex, const char* fragment);
     
     void createFbo(int eye_width, int eye_height, GLuint* fbo,
                    GLuint* color_tex, GLuint* depth_tex);
 
+    // both eyes as layers 0 and 1 of array textures, attached as views if
+    // multiview, layered otherwise
+    void createStereoFbo(int eye_width, int eye_height, bool multiview, GLuint* fbo,
+                         GLuint* color_tex, GLuint* depth_tex);
+
     void deleteFbo(GLuint* fbo, GLuint* color_tex, GLuint* depth_tex);
     
     gl_ctx GlCtx;
+    // eye targets when eyes are drawn one by one, 0 otherwise
     GLuint left_color_tex, left_depth_tex, left_fbo;
     GLuint right_color_tex, right_depth_tex, right_fbo;
-    GLuint shader;
+    // single pass stereo target, 0 if eyes are drawn one by one
+    GLuint stereo_color_tex, stereo_depth_tex, stereo_fbo;
     int eye_w;
     int eye_h;
 private:
-    void compileShaderSrc(GLuint shader, const char* src);
+    static void compileShaderSrc(GLuint shader, const char* src);
 };
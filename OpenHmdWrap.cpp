@@ -4,6 +4,11 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <algorithm>
+#include <poll.h>
+#include <stdlib.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
 #include "TypesConf.h"
 
 OpenHmdWrap::OpenHmdWrap()
@@ -49,20 +54,176 @@ OpenHmdWrap::OpenHmdWrap()
                      : right_lens_center[0];
     warp_adj = 1.0f;
     
-    using namespace std::chrono_literals;
-    for (auto i{0}; i < 150; ++i)
+    auto output = getenv("XMIRROR_HMD_OUTPUT");
+    auto screen = getenv("XMIRROR_HMD_SCREEN");
+    enableOutput(output != nullptr ? output : "HDMI-0",
+                 screen != nullptr ? atoi(screen) : 1);
+}
+
+// true once output scans out, switches it on with preferred mode otherwise
+// unless that was done already; probe asks hardware for outputs, slow, not
+// for polling
+static bool outputReady(Display* display, Window root, const std::string& name, int w, int h,
+                        bool probe, bool& configured)
+{
+    auto res = probe ? XRRGetScreenResources(display, root) : XRRGetScreenResourcesCurrent(display, root);
+    if (res == nullptr)
     {
-        ohmd_ctx_update(omhdCtx);
-        loge_ << "wait for 2nd screen " << i << "\n";
-        auto ret = ::system("xrandr --screen 1 --output HDMI-0 --auto");
-        (void)ret;
-        if (::system("xrandr --screen 1 | grep \"HDMI-0\" | grep -q \"2160x1200\"") == 0)
+        return false;
+    }
+    auto ready{false};
+    for (auto i = 0; i < res->noutput; ++i)
+    {
+        auto info = XRRGetOutputInfo(display, res, res->outputs[i]);
+        if (info == nullptr)
+        {
+            continue;
+        }
+        if (name != std::string(info->name, info->nameLen) || info->connection != RR_Connected || info->nmode == 0)
+        {
+            XRRFreeOutputInfo(info);
+            continue;
+        }
+
+        if (info->crtc != 0)
+        {
+            auto crtc = XRRGetCrtcInfo(display, res, info->crtc);
+            if (crtc != nullptr)
+            {
+                ready = crtc->mode != 0;
+                if (ready && (int(crtc->width) != w || int(crtc->height) != h))
+                {
+                    logw_ << name << " runs " << crtc->width << "x" << crtc->height << ", hmd reports " << w << "x" << h << "\n";
+                }
+                XRRFreeCrtcInfo(crtc);
+            }
+        }
+
+        if (!ready && !configured)
+        {
+            // same as xrandr --auto: preferred mode on first free crtc, right of everything else
+            RRCrtc free{0};
+            auto right{0};
+            for (auto c = 0; c < res->ncrtc; ++c)
+            {
+                auto crtc = XRRGetCrtcInfo(display, res, res->crtcs[c]);
+                if (crtc == nullptr)
+                {
+                    continue;
+                }
+                if (crtc->noutput == 0 && free == 0 &&
+                    std::find(info->crtcs, info->crtcs + info->ncrtc, res->crtcs[c]) != info->crtcs + info->ncrtc)
+                {
+                    free = res->crtcs[c];
+                }
+                if (crtc->mode != 0)
+                {
+                    right = std::max(right, crtc->x + int(crtc->width));
+                }
+                XRRFreeCrtcInfo(crtc);
+            }
+            auto mode = info->modes[0]; // preferred ones come first
+            auto modeInfo = std::find_if(res->modes, res->modes + res->nmode,
+                                         [&](auto& m) { return m.id == mode; });
+            if (free != 0 && modeInfo != res->modes + res->nmode)
+            {
+                auto screen = DefaultScreen(display);
+                for (auto s = 0; s < ScreenCount(display); ++s)
+                {
+                    if (RootWindow(display, s) == root)
+                    {
+                        screen = s;
+                    }
+                }
+                auto width = std::max(DisplayWidth(display, screen), right + int(modeInfo->width));
+                auto height = std::max(DisplayHeight(display, screen), int(modeInfo->height));
+                if (width != DisplayWidth(display, screen) || height != DisplayHeight(display, screen))
+                {
+                    // keep dpi
+                    XRRSetScreenSize(display, root, width, height,
+                                     DisplayWidthMM(display, screen) * width / DisplayWidth(display, screen),
+                                     DisplayHeightMM(display, screen) * height / DisplayHeight(display, screen));
+                }
+                auto id = res->outputs[i];
+                XRRSetCrtcConfig(display, res, free, CurrentTime, right, 0, mode, RR_Rotate_0, &id, 1);
+                XFlush(display);
+                configured = true;
+            }
+        }
+        XRRFreeOutputInfo(info);
+        break;
+    }
+    XRRFreeScreenResources(res);
+    return ready;
+}
+
+void OpenHmdWrap::enableOutput(const std::string& output, int screen)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto display = XOpenDisplay(nullptr);
+    if (display == nullptr)
+    {
+        loge_ << "no X display, " << output << " not configured\n";
+        return;
+    }
+    int eventBase, errorBase;
+    if (!XRRQueryExtension(display, &eventBase, &errorBase))
+    {
+        loge_ << "no RandR, " << output << " not configured\n";
+        XCloseDisplay(display);
+        return;
+    }
+    auto root = RootWindow(display, std::min(screen, ScreenCount(display) - 1));
+    // output plugged in or switched on shows up as RandR events
+    XRRSelectInput(display, root, RRScreenChangeNotifyMask | RROutputChangeNotifyMask | RRCrtcChangeNotifyMask);
+
+    // sleep on X connection until RandR says something changed, resources
+    // are read again only then; give up after 1.5s like before
+    auto deadline = start + std::chrono::milliseconds(1500);
+    auto configured{false};
+    auto ready = outputReady(display, root, output, hmd_w, hmd_h, true, configured);
+    while (!ready)
+    {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0)
         {
             break;
         }
-        std::this_thread::sleep_for(10ms);
+        pollfd fd{ConnectionNumber(display), POLLIN, 0};
+        if (XPending(display) == 0 && poll(&fd, 1, left) <= 0)
+        {
+            continue;
+        }
+        ohmd_ctx_update(omhdCtx);
+        auto changed{false};
+        while (XPending(display))
+        {
+            XEvent event;
+            XNextEvent(display, &event);
+            if (event.type == eventBase + RRScreenChangeNotify)
+            {
+                XRRUpdateConfiguration(&event);
+                changed = true;
+            }else if (event.type == eventBase + RRNotify)
+            {
+                changed = true;
+            }
+        }
+        if (changed)
+        {
+            ready = outputReady(display, root, output, hmd_w, hmd_h, false, configured);
+        }
     }
 
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    if (ready)
+    {
+        logi_ << output << " enabled in " << ms << " ms\n";
+    }else
+    {
+        loge_ << output << " not enabled after " << ms << " ms\n";
+    }
+    XCloseDisplay(display);
 }
 
 OpenHmdWrap::~OpenHmdWrap()
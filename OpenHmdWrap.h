@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 #include <openhmd.h>
 
 class OpenHmdWrap
@@ -20,4 +22,8 @@ public:
     float right_lens_center[2];
     float warp_scale;
     float warp_adj;
+
+private:
+    // switch HMD output on through RandR and wait until it scans out
+    void enableOutput(const std::string& output, int screen);
 };
@@ -0,0 +1,353 @@
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#include "PixelConvert.h"
+
+PixelFormat pixelFormat(const XImage* image)
+{
+    if (image->byte_order != LSBFirst ||
+        image->red_mask == 0 || image->green_mask == 0 || image->blue_mask == 0)
+    {
+        return PIXEL_FORMAT_UNSUPPORTED;
+    }
+    auto masks = [&](unsigned long r, unsigned long g, unsigned long b)
+    {
+        return image->red_mask == r && image->green_mask == g && image->blue_mask == b;
+    };
+    switch (image->bits_per_pixel)
+    {
+        case 32:
+            return masks(0xff0000, 0xff00, 0xff) ? PIXEL_FORMAT_BGRX8888 : PIXEL_FORMAT_GENERIC;
+        case 24:
+            return masks(0xff0000, 0xff00, 0xff) ? PIXEL_FORMAT_BGR888 : PIXEL_FORMAT_GENERIC;
+        case 16:
+            if (masks(0xf800, 0x07e0, 0x001f))
+            {
+                return PIXEL_FORMAT_RGB565;
+            }
+            return masks(0x7c00, 0x03e0, 0x001f) ? PIXEL_FORMAT_RGB555 : PIXEL_FORMAT_GENERIC;
+    }
+    return PIXEL_FORMAT_UNSUPPORTED;
+}
+
+const char* pixelFormatName(PixelFormat format)
+{
+    switch (format)
+    {
+        case PIXEL_FORMAT_BGRX8888: return "bgrx8888";
+        case PIXEL_FORMAT_BGR888:   return "bgr888";
+        case PIXEL_FORMAT_RGB565:   return "rgb565";
+        case PIXEL_FORMAT_RGB555:   return "rgb555";
+        case PIXEL_FORMAT_GENERIC:  return "generic";
+        default:                    return "unsupported";
+    }
+}
+
+// widen n bit channel to 8 bits by replicating its bits, as often as it
+// takes for channels narrower than 4 bits
+static inline uint32_t expand(uint32_t value, int bits)
+{
+    if (bits <= 0)
+    {
+        return 0;
+    }
+    uint32_t result{0};
+    for (auto shift = 8 - bits; shift > -bits; shift -= bits)
+    {
+        result |= shift >= 0 ? value << shift : value >> -shift;
+    }
+    return result & 0xff;
+}
+
+// scalar rows, also handle tails of vector rows
+
+static void rowBgrx8888(const uint8_t* in, uint32_t* out, int from, int width, uint32_t alpha)
+{
+    auto p = reinterpret_cast<const uint32_t*>(in);
+    for (auto col = from; col < width; ++col)
+    {
+        out[col] = (p[col] & 0x00ffffff) | alpha;
+    }
+}
+
+static void rowBgr888(const uint8_t* in, uint32_t* out, int from, int width, uint32_t alpha)
+{
+    for (auto col = from; col < width; ++col)
+    {
+        auto p = in + col * 3;
+        out[col] = alpha | (p[2] << 16) | (p[1] << 8) | p[0];
+    }
+}
+
+static void rowRgb565(const uint8_t* in, uint32_t* out, int from, int width, uint32_t alpha)
+{
+    auto p = reinterpret_cast<const uint16_t*>(in);
+    for (auto col = from; col < width; ++col)
+    {
+        uint32_t v = p[col];
+        out[col] = alpha |
+                   (expand(v >> 11, 5) << 16) |
+                   (expand((v >> 5) & 0x3f, 6) << 8) |
+                   expand(v & 0x1f, 5);
+    }
+}
+
+static void rowRgb555(const uint8_t* in, uint32_t* out, int from, int width, uint32_t alpha)
+{
+    auto p = reinterpret_cast<const uint16_t*>(in);
+    for (auto col = from; col < width; ++col)
+    {
+        uint32_t v = p[col];
+        out[col] = alpha |
+                   (expand((v >> 10) & 0x1f, 5) << 16) |
+                   (expand((v >> 5) & 0x1f, 5) << 8) |
+                   expand(v & 0x1f, 5);
+    }
+}
+
+// vector rows, return number of pixels done
+
+#ifdef __SSE2__
+static int rowBgrx8888Simd(const uint8_t* in, uint32_t* out, int width, uint32_t alpha)
+{
+    auto rgb = _mm_set1_epi32(0x00ffffff);
+    auto a = _mm_set1_epi32(alpha);
+    auto col = 0;
+    for (; col + 4 <= width; col += 4)
+    {
+        auto p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + col * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + col), _mm_or_si128(_mm_and_si128(p, rgb), a));
+    }
+    return col;
+}
+
+// 8 pixels of 16 bit channels b, g, r into bgra
+static inline void store16(uint32_t* out, __m128i b, __m128i g, __m128i r, __m128i a)
+{
+    auto bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+    auto ra = _mm_or_si128(r, a);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi16(bg, ra));
+}
+
+static int rowRgb565Simd(const uint8_t* in, uint32_t* out, int width, uint32_t alpha)
+{
+    auto m5 = _mm_set1_epi16(0x1f);
+    auto m6 = _mm_set1_epi16(0x3f);
+    auto a = _mm_set1_epi16(static_cast<short>(alpha >> 16));
+    auto col = 0;
+    for (; col + 8 <= width; col += 8)
+    {
+        auto p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + col * 2));
+        auto r = _mm_and_si128(_mm_srli_epi16(p, 11), m5);
+        auto g = _mm_and_si128(_mm_srli_epi16(p, 5), m6);
+        auto b = _mm_and_si128(p, m5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        store16(out + col, b, g, r, a);
+    }
+    return col;
+}
+
+static int rowRgb555Simd(const uint8_t* in, uint32_t* out, int width, uint32_t alpha)
+{
+    auto m5 = _mm_set1_epi16(0x1f);
+    auto a = _mm_set1_epi16(static_cast<short>(alpha >> 16));
+    auto col = 0;
+    for (; col + 8 <= width; col += 8)
+    {
+        auto p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + col * 2));
+        auto r = _mm_and_si128(_mm_srli_epi16(p, 10), m5);
+        auto g = _mm_and_si128(_mm_srli_epi16(p, 5), m5);
+        auto b = _mm_and_si128(p, m5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        store16(out + col, b, g, r, a);
+    }
+    return col;
+}
+#endif
+
+#ifdef __SSSE3__
+static int rowBgr888Simd(const uint8_t* in, uint32_t* out, int width, uint32_t alpha)
+{
+    auto shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    auto a = _mm_set1_epi32(alpha);
+    auto col = 0;
+    // 16 byte load covers 4 pixels plus 4 bytes of next ones, stay inside row
+    for (; col + 6 <= width; col += 4)
+    {
+        auto p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + col * 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + col), _mm_or_si128(_mm_shuffle_epi8(p, shuffle), a));
+    }
+    return col;
+}
+#endif
+
+void convertPixels(PixelFormat format, const uint8_t* in, size_t inStride,
+                   uint8_t* out, int width, int height, uint8_t alpha, [[maybe_unused]] bool simd)
+{
+    auto a = static_cast<uint32_t>(alpha) << 24;
+    for (auto row = 0; row < height; ++row)
+    {
+        auto i = in + row * inStride;
+        auto o = reinterpret_cast<uint32_t*>(out) + row * width;
+        auto done = 0;
+        switch (format)
+        {
+            case PIXEL_FORMAT_BGRX8888:
+#ifdef __SSE2__
+                done = simd ? rowBgrx8888Simd(i, o, width, a) : 0;
+#endif
+                rowBgrx8888(i, o, done, width, a);
+                break;
+            case PIXEL_FORMAT_BGR888:
+#ifdef __SSSE3__
+                done = simd ? rowBgr888Simd(i, o, width, a) : 0;
+#endif
+                rowBgr888(i, o, done, width, a);
+                break;
+            case PIXEL_FORMAT_RGB565:
+#ifdef __SSE2__
+                done = simd ? rowRgb565Simd(i, o, width, a) : 0;
+#endif
+                rowRgb565(i, o, done, width, a);
+                break;
+            case PIXEL_FORMAT_RGB555:
+#ifdef __SSE2__
+                done = simd ? rowRgb555Simd(i, o, width, a) : 0;
+#endif
+                rowRgb555(i, o, done, width, a);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// any masks, one pixel at a time
+static void convertGeneric(const XImage* image, uint8_t* out, uint32_t alpha)
+{
+    auto shift = [](unsigned long mask) { return __builtin_ctzl(mask); };
+    auto bits = [](unsigned long mask) { return std::min(8, __builtin_popcountl(mask)); };
+    int rs = shift(image->red_mask), gs = shift(image->green_mask), bs = shift(image->blue_mask);
+    int rb = bits(image->red_mask), gb = bits(image->green_mask), bb = bits(image->blue_mask);
+    // channels wider than 8 bits keep their top 8 bits
+    auto rx = __builtin_popcountl(image->red_mask) - rb;
+    auto gx = __builtin_popcountl(image->green_mask) - gb;
+    auto bx = __builtin_popcountl(image->blue_mask) - bb;
+    auto bytes = image->bits_per_pixel / 8;
+    for (auto row = 0; row < image->height; ++row)
+    {
+        auto in = reinterpret_cast<const uint8_t*>(image->data) + row * image->bytes_per_line;
+        auto o = reinterpret_cast<uint32_t*>(out) + row * image->width;
+        for (auto col = 0; col < image->width; ++col)
+        {
+            uint32_t v{0};
+            memcpy(&v, in + col * bytes, bytes);
+            o[col] = alpha |
+                     (expand(((v & image->red_mask) >> rs) >> rx, rb) << 16) |
+                     (expand(((v & image->green_mask) >> gs) >> gx, gb) << 8) |
+                     expand(((v & image->blue_mask) >> bs) >> bx, bb);
+        }
+    }
+}
+
+void packRgb565(const uint8_t* bgra, uint8_t* out, size_t pixels, [[maybe_unused]] bool simd)
+{
+    auto in = reinterpret_cast<const uint32_t*>(bgra);
+    auto o = reinterpret_cast<uint16_t*>(out);
+    size_t i{0};
+#ifdef __SSE2__
+    if (simd)
+    {
+        auto mr = _mm_set1_epi32(0xf800);
+        auto mg = _mm_set1_epi32(0x07e0);
+        auto mb = _mm_set1_epi32(0x001f);
+        // packs saturates signed, move values around zero and back
+        auto bias32 = _mm_set1_epi32(0x8000);
+        auto bias16 = _mm_set1_epi16(static_cast<short>(0x8000));
+        auto pack = [&](__m128i p)
+        {
+            auto v = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 8), mr),
+                                               _mm_and_si128(_mm_srli_epi32(p, 5), mg)),
+                                  _mm_and_si128(_mm_srli_epi32(p, 3), mb));
+            return _mm_sub_epi32(v, bias32);
+        };
+        for (; i + 8 <= pixels; i += 8)
+        {
+            auto lo = pack(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+            auto hi = pack(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 4)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + i), _mm_add_epi16(_mm_packs_epi32(lo, hi), bias16));
+        }
+    }
+#endif
+    for (; i < pixels; ++i)
+    {
+        o[i] = static_cast<uint16_t>(((in[i] >> 8) & 0xf800) | ((in[i] >> 5) & 0x07e0) | ((in[i] >> 3) & 0x001f));
+    }
+}
+
+bool convertImage565(const XImage* image, uint8_t* out)
+{
+    auto format = pixelFormat(image);
+    if (format == PIXEL_FORMAT_UNSUPPORTED)
+    {
+        return false;
+    }
+    auto width = static_cast<size_t>(image->width);
+    auto in = reinterpret_cast<const uint8_t*>(image->data);
+    if (format == PIXEL_FORMAT_RGB565)
+    {
+        for (auto row = 0; row < image->height; ++row)
+        {
+            memcpy(out + row * width * 2, in + row * image->bytes_per_line, width * 2);
+        }
+        return true;
+    }
+    // through BGRA, a row at a time so it stays in cache
+    thread_local std::vector<uint8_t> bgra;
+    if (format == PIXEL_FORMAT_GENERIC)
+    {
+        bgra.resize(width * image->height * 4);
+        convertGeneric(image, bgra.data(), 0);
+        packRgb565(bgra.data(), out, width * image->height);
+        return true;
+    }
+    bgra.resize(width * 4);
+    for (auto row = 0; row < image->height; ++row)
+    {
+        convertPixels(format, in + row * image->bytes_per_line, image->bytes_per_line, bgra.data(),
+                      image->width, 1, 0);
+        packRgb565(bgra.data(), out + row * width * 2, width);
+    }
+    return true;
+}
+
+bool convertImage(const XImage* image, uint8_t* out, uint8_t alpha)
+{
+    auto format = pixelFormat(image);
+    if (format == PIXEL_FORMAT_UNSUPPORTED)
+    {
+        return false;
+    }
+    if (format == PIXEL_FORMAT_GENERIC)
+    {
+        convertGeneric(image, out, static_cast<uint32_t>(alpha) << 24);
+        return true;
+    }
+
+    convertPixels(format, reinterpret_cast<const uint8_t*>(image->data),
+                  image->bytes_per_line, out, image->width, image->height, alpha);
+    return true;
+}
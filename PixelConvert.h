@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+// Source layouts with dedicated converters, anything else with 16, 24 or 32
+// bits per pixel goes through the slow mask based path.
+enum PixelFormat
+{
+    PIXEL_FORMAT_UNSUPPORTED,
+    PIXEL_FORMAT_BGRX8888,
+    PIXEL_FORMAT_BGR888,
+    PIXEL_FORMAT_RGB565,
+    PIXEL_FORMAT_RGB555,
+    PIXEL_FORMAT_GENERIC
+};
+
+PixelFormat pixelFormat(const XImage* image);
+const char* pixelFormatName(PixelFormat format);
+
+// Converts rows of known format into tightly packed BGRA with given alpha.
+// simd selects vector code where the cpu has it, scalar is kept for
+// benchmarking and odd tails.
+void convertPixels(PixelFormat format, const uint8_t* in, size_t inStride,
+                   uint8_t* out, int width, int height, uint8_t alpha,
+                   bool simd = true);
+
+// Converts captured XImage into tightly packed BGRA rows with given alpha.
+// Returns false if the image format is not supported.
+bool convertImage(const XImage* image, uint8_t* out, uint8_t alpha);
+
+// Packs BGRA pixels into RGB565, top bits of each channel are kept.
+void packRgb565(const uint8_t* bgra, uint8_t* out, size_t pixels, bool simd = true);
+
+// Same as convertImage but into tightly packed RGB565 rows, half the bytes,
+// for windows in background. RGB565 sources are copied as they are.
+bool convertImage565(const XImage* image, uint8_t* out);
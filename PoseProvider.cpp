@@ -0,0 +1,170 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "PoseProvider.h"
+
+namespace
+{
+
+// a sample is too old to derive velocity from after this
+const auto kMaxSampleGap = std::chrono::milliseconds(100);
+// never predict further, a stalled frame should not swing the view
+const auto kMaxLead = std::chrono::milliseconds(50);
+// head turns faster than 20 rad/s are tracker jumps
+const float kMaxVelocity = 20.0f;
+
+cl_float4 mult(const cl_float4& a, const cl_float4& b)
+{
+    return cl_float4{a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                     a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                     a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+                     a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z};
+}
+
+cl_float4 conj(const cl_float4& q)
+{
+    return cl_float4{-q.x, -q.y, -q.z, q.w};
+}
+
+// rotation vector, axis times angle, of unit quaternion
+cl_float4 toVector(cl_float4 q)
+{
+    if (q.w < 0)
+    {
+        q = cl_float4{-q.x, -q.y, -q.z, -q.w};
+    }
+    auto s = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z);
+    if (s < 1e-7f)
+    {
+        return cl_float4{0, 0, 0, 0};
+    }
+    auto angle = 2 * atan2f(s, q.w) / s;
+    return cl_float4{q.x * angle, q.y * angle, q.z * angle, 0};
+}
+
+cl_float4 fromVector(const cl_float4& v)
+{
+    auto angle = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    if (angle < 1e-7f)
+    {
+        return cl_float4{0, 0, 0, 1};
+    }
+    auto s = sinf(angle / 2) / angle;
+    return cl_float4{v.x * s, v.y * s, v.z * s, cosf(angle / 2)};
+}
+
+float seconds(PoseProvider::Clock::duration d)
+{
+    return std::chrono::duration<float>(d).count();
+}
+
+}
+
+PoseProvider::PoseProvider(ohmd_context* ctx, ohmd_device* hmd)
+    : mCtx{ctx},
+      mHmd{hmd},
+      mLast{0, 0, 0, 1},
+      mHaveLast{false},
+      mVelocity{0, 0, 0, 0},
+      mLead{std::chrono::milliseconds(16)},
+      mRefresh{std::chrono::milliseconds(16)},
+      mLatched{{0, 0, 0, 1}, {0, 0, 0, 0}, Clock::now()}
+{
+}
+
+PoseProvider::Pose PoseProvider::read()
+{
+    ohmd_ctx_update(mCtx);
+    Pose pose{{0, 0, 0, 1}, {0, 0, 0, 0}, Clock::now()};
+    ohmd_device_getf(mHmd, OHMD_ROTATION_QUAT, &pose.rotation.x);
+    ohmd_device_getf(mHmd, OHMD_POSITION_VECTOR, &pose.position.x);
+    return pose;
+}
+
+PoseProvider::Pose PoseProvider::latch()
+{
+    auto sample = read();
+    auto& rotation = sample.rotation;
+    auto now = sample.time;
+
+    if (mHaveLast && now - mLastTime < kMaxSampleGap && now > mLastTime)
+    {
+        auto delta = toVector(mult(rotation, conj(mLast)));
+        auto dt = seconds(now - mLastTime);
+        cl_float4 velocity{delta.x / dt, delta.y / dt, delta.z / dt, 0};
+        auto speed = sqrtf(velocity.x * velocity.x + velocity.y * velocity.y + velocity.z * velocity.z);
+        if (speed < kMaxVelocity)
+        {
+            // samples come once a frame, smooth out tracker noise
+            mVelocity.x += (velocity.x - mVelocity.x) * 0.5f;
+            mVelocity.y += (velocity.y - mVelocity.y) * 0.5f;
+            mVelocity.z += (velocity.z - mVelocity.z) * 0.5f;
+        }
+    } else
+    {
+        mVelocity = cl_float4{0, 0, 0, 0};
+    }
+    mLast = rotation;
+    mLastTime = now;
+    mHaveLast = true;
+
+    auto ahead = seconds(mLead);
+    auto turn = fromVector(cl_float4{mVelocity.x * ahead, mVelocity.y * ahead, mVelocity.z * ahead, 0});
+    mLatched = Pose{mult(turn, rotation), sample.position, now + mLead};
+    mLatchTime = now;
+    return mLatched;
+}
+
+PoseProvider::Pose PoseProvider::predict(Clock::time_point when)
+{
+    auto sample = read();
+    auto ahead = seconds(std::min<Clock::duration>(std::max<Clock::duration>(when - sample.time, Clock::duration{0}),
+                                                   kMaxLead));
+    auto turn = fromVector(cl_float4{mVelocity.x * ahead, mVelocity.y * ahead, mVelocity.z * ahead, 0});
+    return Pose{mult(turn, sample.rotation), sample.position, when};
+}
+
+void PoseProvider::presented()
+{
+    // swap returns around vblank, scan out reaches middle of panel half a
+    // refresh later
+    auto now = Clock::now();
+    if (mLastPresent != Clock::time_point{} && now - mLastPresent < kMaxLead)
+    {
+        mRefresh += (now - mLastPresent - mRefresh) / 8;
+    }
+    mLastPresent = now;
+    auto lead = std::min<Clock::duration>(now - mLatchTime + mRefresh / 2, kMaxLead);
+    mLead += (lead - mLead) / 8;
+}
+
+void PoseProvider::reset()
+{
+    mHaveLast = false;
+    mVelocity = cl_float4{0, 0, 0, 0};
+}
+
+void PoseProvider::modelview(const Pose& pose, float ipd, int eye, GLfloat out[16])
+{
+    // world moved by inverse of head position and orientation, then by half
+    // of IPD, what OpenHMD gives as eye matrices for its own pose
+    auto q = conj(pose.rotation);
+    out[0] = 1 - 2 * (q.y * q.y + q.z * q.z);
+    out[1] = 2 * (q.x * q.y + q.w * q.z);
+    out[2] = 2 * (q.x * q.z - q.w * q.y);
+    out[3] = 0;
+    out[4] = 2 * (q.x * q.y - q.w * q.z);
+    out[5] = 1 - 2 * (q.x * q.x + q.z * q.z);
+    out[6] = 2 * (q.y * q.z + q.w * q.x);
+    out[7] = 0;
+    out[8] = 2 * (q.x * q.z + q.w * q.y);
+    out[9] = 2 * (q.y * q.z - q.w * q.x);
+    out[10] = 1 - 2 * (q.x * q.x + q.y * q.y);
+    out[11] = 0;
+    auto& p = pose.position;
+    out[12] = -(out[0] * p.x + out[4] * p.y + out[8] * p.z) + (eye == 0 ? ipd / 2 : -ipd / 2);
+    out[13] = -(out[1] * p.x + out[5] * p.y + out[9] * p.z);
+    out[14] = -(out[2] * p.x + out[6] * p.y + out[10] * p.z);
+    out[15] = 1;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+
+#include <GL/gl.h>
+#include <openhmd.h>
+
+#include "TypesConf.h"
+
+// HMD orientation for a frame. Read from the tracker once at frame start,
+// before gaze picking and drawing, and extrapolated with angular velocity
+// of recent samples to when the frame is expected on the display; that lead
+// is learned from how long latched frames took to get through the swap.
+// Both eyes and gaze picking use the one pose latched per frame.
+//
+// Opengl thread only.
+class PoseProvider
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Pose
+    {
+        // orientation quaternion x y z w, what OHMD_ROTATION_QUAT gives
+        cl_float4 rotation;
+        // OHMD_POSITION_VECTOR, not predicted
+        cl_float4 position;
+        // display time pose is predicted for
+        Clock::time_point time;
+    };
+
+    PoseProvider(ohmd_context* ctx, ohmd_device* hmd);
+
+    // reads tracker now, predicts to scan out of frame drawn with it
+    Pose latch();
+    // reads tracker now, predicts to given time; for reprojection of a
+    // frame latched earlier, does not change what latch() learns from
+    Pose predict(Clock::time_point when);
+    // frame of last latch() was handed to display, swap returned
+    void presented();
+    // tracker was reset, velocity of old samples means nothing
+    void reset();
+
+    Pose latched() const { return mLatched; }
+    // how far ahead latch() predicts
+    Clock::duration lead() const { return mLead; }
+
+    // eye 0 left, 1 right; column major like OHMD_*_EYE_GL_MODELVIEW_MATRIX
+    static void modelview(const Pose& pose, float ipd, int eye, GLfloat out[16]);
+
+private:
+    Pose read();
+
+    ohmd_context* mCtx;
+    ohmd_device* mHmd;
+    cl_float4 mLast;
+    Clock::time_point mLastTime;
+    bool mHaveLast;
+    // smoothed angular velocity, axis times radians per second
+    cl_float4 mVelocity;
+    Clock::duration mLead;
+    // time between presented frames, display refresh unless we miss vsync
+    Clock::duration mRefresh;
+    Clock::time_point mLastPresent;
+    Pose mLatched;
+    Clock::time_point mLatchTime;
+};
@@ -0,0 +1,304 @@
+// Scene submission benchmark. Draws a grid of textured mirror quads into an
+// offscreen framebuffer, once as one VertexBatch quad per mirror (a draw
+// call per texture) and once as InstanceBatch instances, and reports
+// frames/s, draw calls and CPU time spent submitting a frame.
+//
+// render_bench [--mirrors N]... [--textures N] [--seconds S]
+//
+// Default is 10, 100 and 1000 mirrors each with its own texture; --textures
+// lets mirrors share fewer textures, like windows packed into atlas pages.
+// Both paths must produce the same picture, exit code is non-zero if they
+// differ. Without a GPU run it on llvmpipe:
+//
+// LIBGL_ALWAYS_SOFTWARE=1 ./render_bench
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+
+#include "EyeViews.h"
+#include "InstanceBatch.h"
+#include "TypesConf.h"
+#include "VertexBatch.h"
+
+struct Options
+{
+    std::vector<size_t> mirrors;
+    size_t textures{0};
+    int seconds{3};
+};
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options opt;
+    for (auto i{1}; i < argc; ++i)
+    {
+        std::string arg{argv[i]};
+        auto next = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                throw Error("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+        if (arg == "--mirrors")
+        {
+            opt.mirrors.push_back(std::stoul(next()));
+        } else if (arg == "--textures")
+        {
+            opt.textures = std::stoul(next());
+        } else if (arg == "--seconds")
+        {
+            opt.seconds = std::stoi(next());
+        } else
+        {
+            throw Error("unknown option " + arg);
+        }
+    }
+    if (opt.mirrors.empty())
+    {
+        opt.mirrors = {10, 100, 1000};
+    }
+    return opt;
+}
+
+static const int kWidth{1280};
+static const int kHeight{720};
+static const int kTextureSize{64};
+
+// stripes in a color of its own, so a wrong texture shows in comparison
+static GLuint makeTexture(size_t index)
+{
+    std::vector<GLubyte> pixels(kTextureSize * kTextureSize * 4);
+    GLubyte r = (index * 67) & 0xff, g = (index * 131) & 0xff, b = (index * 29) & 0xff;
+    for (int y = 0; y < kTextureSize; ++y)
+    {
+        for (int x = 0; x < kTextureSize; ++x)
+        {
+            auto p = &pixels[(y * kTextureSize + x) * 4];
+            auto stripe = ((x + y) / 8) & 1;
+            p[0] = stripe ? r : 255 - r;
+            p[1] = stripe ? g : 255 - g;
+            p[2] = stripe ? b : 255 - b;
+            p[3] = 255;
+        }
+    }
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, kTextureSize, kTextureSize, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 pixels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+// mirrors in a grid at distance 5 filling 90 degree field of view, not
+// rotated so quads path can place corners without quaternions
+static std::vector<InstanceBatch::Instance> layout(size_t mirrors)
+{
+    auto columns = static_cast<size_t>(ceil(sqrt(mirrors * 16.0 / 9.0)));
+    auto rows = (mirrors + columns - 1) / columns;
+    GLfloat cellWidth = 16.0f / columns;
+    GLfloat cellHeight = 9.0f / rows;
+    std::vector<InstanceBatch::Instance> instances;
+    for (size_t i = 0; i < mirrors; ++i)
+    {
+        InstanceBatch::Instance instance{};
+        instance.position[0] = -8.0f + cellWidth * (i % columns + 0.5f);
+        instance.position[1] = 4.5f - cellHeight * (i / columns + 0.5f);
+        instance.halfWidth = cellWidth * 0.45f;
+        instance.halfHeight = cellHeight * 0.45f;
+        instance.rotation[3] = 1.0f;
+        instance.uv[2] = instance.uv[3] = 1.0f;
+        std::fill(instance.color, instance.color + 4, 1.0f);
+        instances.push_back(instance);
+    }
+    return instances;
+}
+
+static VertexBatch::Vertex corner(const InstanceBatch::Instance& instance, GLfloat sx, GLfloat sy)
+{
+    return VertexBatch::Vertex{instance.position[0] + sx * instance.halfWidth,
+                               instance.position[1] + sy * instance.halfHeight,
+                               instance.position[2] - 5.0f,
+                               sx < 0 ? instance.uv[0] : instance.uv[2],
+                               sy > 0 ? instance.uv[1] : instance.uv[3],
+                               instance.color[0], instance.color[1], instance.color[2], instance.color[3]};
+}
+
+struct Result
+{
+    double fps;
+    double submitUs;
+    size_t draws;
+    std::vector<GLubyte> pixels;
+};
+
+static Result run(int seconds, const std::function<size_t()>& frame)
+{
+    Result result{};
+    size_t frames{0};
+    std::chrono::nanoseconds submit{0};
+    // first frame uploads buffers, not counted
+    frame();
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::seconds(seconds);
+    for (; std::chrono::steady_clock::now() < end || frames == 0; ++frames)
+    {
+        auto before = std::chrono::steady_clock::now();
+        glClear(GL_COLOR_BUFFER_BIT);
+        result.draws = frame();
+        submit += std::chrono::steady_clock::now() - before;
+        glFinish();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.fps = frames / elapsed;
+    result.submitUs = std::chrono::duration<double, std::micro>(submit).count() / frames;
+    result.pixels.resize(kWidth * kHeight * 4);
+    glReadPixels(0, 0, kWidth, kHeight, GL_RGBA, GL_UNSIGNED_BYTE, result.pixels.data());
+    return result;
+}
+
+// share of pixels off by more than rounding
+static double difference(const std::vector<GLubyte>& a, const std::vector<GLubyte>& b)
+{
+    size_t differ{0};
+    for (size_t i = 0; i < a.size(); i += 4)
+    {
+        for (size_t c = 0; c < 3; ++c)
+        {
+            if (abs(a[i + c] - b[i + c]) > 2)
+            {
+                ++differ;
+                break;
+            }
+        }
+    }
+    return static_cast<double>(differ) / (a.size() / 4);
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    try
+    {
+        opt = parseOptions(argc, argv);
+    } catch (const std::exception& e)
+    {
+        std::cout << "ERROR: " << e.what() << "\n";
+        return 2;
+    } catch (const Error& e)
+    {
+        std::cout << "ERROR: " << e.mMsg << "\n";
+        return 2;
+    }
+
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        std::cout << "ERROR: SDL_Init failed " << SDL_GetError() << "\n";
+        return 2;
+    }
+    auto window = SDL_CreateWindow("render_bench", 0, 0, 64, 64, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    auto context = window ? SDL_GL_CreateContext(window) : nullptr;
+    if (context == nullptr)
+    {
+        std::cout << "ERROR: no OpenGL context " << SDL_GetError() << "\n";
+        return 2;
+    }
+    glewInit();
+    if (!VertexBatch::supported() || !InstanceBatch::supported())
+    {
+        std::cout << "ERROR: OpenGL 3.3 with vertex array objects needed, have " << glGetString(GL_VERSION) << "\n";
+        return 2;
+    }
+    std::cout << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << "\n";
+
+    // offscreen target, hidden window may have no pixels of its own
+    GLuint fbo, color;
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &color);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, kWidth, kHeight);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glViewport(0, 0, kWidth, kHeight);
+    glClearColor(0, 0, 0, 1);
+
+    // 90 degree vertical field of view, near 0.1, far 100
+    GLfloat aspect = static_cast<GLfloat>(kWidth) / kHeight;
+    GLfloat n = 0.1f, f = 100.0f;
+    const GLfloat projection[16] = {1.0f / aspect, 0, 0, 0,
+                                    0, 1, 0, 0,
+                                    0, 0, (f + n) / (n - f), -1,
+                                    0, 0, 2 * f * n / (n - f), 0};
+    const GLfloat modelview[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    EyeViews views{Stereo::Single, {}, {}};
+    std::copy(projection, projection + 16, views.projection[0]);
+    std::copy(modelview, modelview + 16, views.modelview[0]);
+
+    auto exitCode{0};
+    for (auto mirrors : opt.mirrors)
+    {
+        auto textureCount = opt.textures != 0 ? std::min(opt.textures, mirrors) : mirrors;
+        std::vector<GLuint> textures;
+        for (size_t i = 0; i < textureCount; ++i)
+        {
+            textures.push_back(makeTexture(i));
+        }
+        auto instances = layout(mirrors);
+
+        VertexBatch quads;
+        InstanceBatch instanced;
+        for (size_t i = 0; i < mirrors; ++i)
+        {
+            auto& instance = instances[i];
+            VertexBatch::Vertex corners[4] = {corner(instance, -1, 1), corner(instance, -1, -1),
+                                              corner(instance, 1, -1), corner(instance, 1, 1)};
+            quads.quad(corners, textures[i % textureCount]);
+            instanced.add(instance, textures[i % textureCount]);
+        }
+
+        auto perQuad = run(opt.seconds, [&]()
+        {
+            quads.draw(views);
+            return quads.runs();
+        });
+        auto perInstance = run(opt.seconds, [&]()
+        {
+            instanced.draw(views);
+            return instanced.draws();
+        });
+
+        auto differ = difference(perQuad.pixels, perInstance.pixels);
+        printf("%5zu mirrors %5zu textures: quads %5zu draws %8.1f fps %8.1f us submit,"
+               " instanced %4zu draws %8.1f fps %8.1f us submit, %.2f%% pixels differ\n",
+               mirrors, textureCount, perQuad.draws, perQuad.fps, perQuad.submitUs,
+               perInstance.draws, perInstance.fps, perInstance.submitUs, differ * 100);
+        // edges of quads may rasterize a pixel apart, nothing more
+        if (differ > 0.01)
+        {
+            printf("ERROR: instanced picture differs from quads\n");
+            exitCode = 1;
+        }
+        glDeleteTextures(textures.size(), textures.data());
+    }
+
+    SDL_GL_DeleteContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return exitCode;
+}
@@ -4,16 +4,23 @@
 #include <algorithm>
 
 #include <GL/glew.h>
-#include <GL/glut.h>
 
 #include "RenderingEngine.h"
 #include "Client.h"
+#include "InstanceBatch.h"
+#include "StrokeFont.h"
 
-RenderingEngine::RenderingEngine(int argc, char** argv, std::vector<std::shared_ptr<Client> >& clients)
+RenderingEngine::RenderingEngine(std::vector<std::shared_ptr<Client> >& clients)
     : OpenGlWrap(OpenHmdWrap::hmd_w, OpenHmdWrap::hmd_h), 
       lookat{0, 0, 0, 0},
       whereami{0, 0, 0, 0},
       mRotation{0,0,0,1},
+      mPose{omhdCtx, hmd},
+      mRenderedPose{mPose.latched()},
+      mRenderedProjection{},
+      mTimewarp{true},
+      mDistortionOff{false},
+      mStereo{Stereo::Single},
       mClients{clients},
       mDone{false}
 {
@@ -21,149 +28,180 @@ RenderingEngine::RenderingEngine(int argc, char** argv, std::vector<std::shared_
 
     mCounters["render_scene_time"] = 0;
     mCounters["fps"] = 0;
+    mCounters["pose_lead"] = 0;
 
-    glutInit(&argc, argv);
-
-    const char* vertex;
-    ohmd_gets(OHMD_GLSL_DISTORTION_VERT_SRC, &vertex);
-    const char* fragment;
-    ohmd_gets(OHMD_GLSL_DISTORTION_FRAG_SRC, &fragment);
-
-    shader = compileShaders(vertex, fragment);
-    glUseProgram(shader);
-    glUniform1i(glGetUniformLocation(shader, "warpTexture"), 0);
-    glUniform2fv(glGetUniformLocation(shader, "ViewportScale"), 1,
-                 viewport_scale);
-    glUniform4fv(glGetUniformLocation(shader, "HmdWarpParam"), 1,
-                 distortion_coeffs);
-    glUniform3fv(glGetUniformLocation(shader, "aberr"), 1, aberr_scale);
-    glUniform1f(glGetUniformLocation(shader, "WarpScale"),
-                warp_scale * warp_adj);
-    glUseProgram(0);
+    if (!VertexBatch::supported() || !InstanceBatch::supported())
+    {
+        throw Error("OpenGL 3.3 with vertex array objects needed");
+    }
+
+    auto timewarp = getenv("XMIRROR_TIMEWARP");
+    mTimewarp = timewarp == nullptr || atoi(timewarp) != 0;
 
     eye_w = hmd_w / 2 * OVERSAMPLE_SCALE;
     eye_h = hmd_h * OVERSAMPLE_SCALE;
-    createFbo(eye_w, eye_h, &left_fbo, &left_color_tex, &left_depth_tex);
-
-    createFbo(eye_w, eye_h, &right_fbo, &right_color_tex, &right_depth_tex);
+    // best single pass stereo driver has, XMIRROR_STEREO picks one
+    auto wanted = getenv("XMIRROR_STEREO");
+    for (auto stereo : {Stereo::Multiview, Stereo::Instanced, Stereo::Single})
+    {
+        if (wanted != nullptr && strcmp(wanted, EyeViews::name(stereo)) != 0)
+        {
+            continue;
+        }
+        if (EyeViews::supported(stereo))
+        {
+            mStereo = stereo;
+            break;
+        }
+        logw_ << "stereo " << EyeViews::name(stereo) << " not supported\n";
+    }
+    if (mStereo != Stereo::Single)
+    {
+        createStereoFbo(eye_w, eye_h, mStereo == Stereo::Multiview, &stereo_fbo, &stereo_color_tex,
+                        &stereo_depth_tex);
+    } else
+    {
+        createFbo(eye_w, eye_h, &left_fbo, &left_color_tex, &left_depth_tex);
+        createFbo(eye_w, eye_h, &right_fbo, &right_color_tex, &right_depth_tex);
+    }
+    logi_ << "stereo " << EyeViews::name(mStereo) << "\n";
 
     generateScene();
+
+    if (GlCtx.uploadContext != nullptr)
+    {
+        mUploader = std::make_unique<UploadThread>(GlCtx.uploadWindow, GlCtx.uploadContext);
+    }
     
     mXinput = std::make_unique<Xinput>(nullptr, 0, std::bind(&RenderingEngine::handleInput, this, std::placeholders::_1));
 }
 
 void RenderingEngine::draw_crosshairs(float len, float cx, float cy)
 {
-    GLint org_line_width{1};
-
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glGetIntegerv(GL_LINE_WIDTH, &org_line_width);
-    glLineWidth(2.0);
-    glColor4f(1.0, 0.5, 0.0, 1.0);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    glBegin(GL_LINES);
     float l = len / 2.0f;
-    glVertex3f(cx - l, cy, 0.0);
-    glVertex3f(cx + l, cy, 0.0);
-    glVertex3f(cx, cy - l, 0.0);
-    glVertex3f(cx, cy + l, 0.0);
-    glEnd();
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
-    glLineWidth(org_line_width);
+    auto point = [](float x, float y)
+    {
+        return VertexBatch::Vertex{x, y, 0, 0, 0, 1.0f, 0.5f, 0.0f, 1.0f};
+    };
+    mHud.line(point(cx - l, cy), point(cx + l, cy));
+    mHud.line(point(cx, cy - l), point(cx, cy + l));
 }
 
-void RenderingEngine::renderSceneToFrameBuffer(bool leftEye)
+void RenderingEngine::latchPose()
 {
-    float matrix[16];
-    auto x{0.0};
-    auto y{0.0};
-    //calculate center for given eye
-    if (leftEye)
+    // latest pose there is, predicted to when this frame is seen
+    mRenderedPose = mPose.latch();
+    mRotation = mRenderedPose.rotation;
+    cl_float4 forw{0, 0, -1, 0};
+    lookat = rotate_vertex_position(forw, mRotation);
+    mCounters["pose_lead"] = std::chrono::duration_cast<std::chrono::microseconds>(mPose.lead()).count();
+}
+
+void RenderingEngine::renderEyes()
+{
+    auto& pose = mRenderedPose;
+    float ipd{0.0};
+    ohmd_device_getf(hmd, OHMD_EYE_IPD, &ipd);
+    EyeViews views{mStereo, {}, {}};
+    EyeViews hud{mStereo, {}, {}};
+    for (auto eye : {0, 1})
     {
-        x = 2 * left_lens_center[0] / viewport_scale[0] - 1.0f;
-        y = 2 * left_lens_center[1] / viewport_scale[1] - 1.0f;
-    } else
+        ohmd_device_getf(hmd, eye == 0 ? OHMD_LEFT_EYE_GL_PROJECTION_MATRIX
+                                       : OHMD_RIGHT_EYE_GL_PROJECTION_MATRIX,
+                         views.projection[eye]);
+        std::copy(views.projection[eye], views.projection[eye] + 16, mRenderedProjection[eye]);
+        PoseProvider::modelview(pose, ipd, eye, views.modelview[eye]);
+
+        // hud is built around 0,0 and moved to lens center of eye
+        auto lensCenter = eye == 0 ? left_lens_center : right_lens_center;
+        for (auto i = 0; i < 16; ++i)
+        {
+            hud.projection[eye][i] = hud.modelview[eye][i] = i % 5 == 0 ? 1.0f : 0.0f;
+        }
+        hud.projection[eye][12] = 2 * lensCenter[0] / viewport_scale[0] - 1.0f;
+        hud.projection[eye][13] = 2 * lensCenter[1] / viewport_scale[1] - 1.0f;
+    }
+
+    mHud.clear();
+    if (mRenderedItems["crosshair_overlay"]) {
+        draw_crosshairs(0.1, 0, 0);
+    }
+    draw_hud(-0.35, -0.4);
+
+    if (mStereo != Stereo::Single)
     {
-        x = 2 * right_lens_center[0] / viewport_scale[0] - 1.0f;
-        y = 2 * right_lens_center[1] / viewport_scale[1] - 1.0f;
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, stereo_fbo);
+        renderSceneToFrameBuffer(views, hud);
+        return;
     }
 
-    // set hmd rotation, for left eye.
-    glMatrixMode(GL_PROJECTION);
-    ohmd_device_getf(hmd, leftEye ? OHMD_LEFT_EYE_GL_PROJECTION_MATRIX
-                                  : OHMD_RIGHT_EYE_GL_PROJECTION_MATRIX,
-                     matrix);
-    glLoadMatrixf(matrix);
-
-    glMatrixMode(GL_MODELVIEW);
-    ohmd_device_getf(hmd, leftEye ? OHMD_LEFT_EYE_GL_MODELVIEW_MATRIX
-                                  : OHMD_RIGHT_EYE_GL_MODELVIEW_MATRIX,
-                     matrix);
-    glLoadMatrixf(matrix);
-
-    // Draw scene into framebuffer.
-    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, leftEye ? left_fbo : right_fbo);
+    // one eye at a time, right one moved to index 0
+    for (auto eye : {0, 1})
+    {
+        if (eye == 1)
+        {
+            std::copy(views.projection[1], views.projection[1] + 16, views.projection[0]);
+            std::copy(views.modelview[1], views.modelview[1] + 16, views.modelview[0]);
+            std::copy(hud.projection[1], hud.projection[1] + 16, hud.projection[0]);
+        }
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, eye == 0 ? left_fbo : right_fbo);
+        renderSceneToFrameBuffer(views, hud);
+    }
+}
+
+void RenderingEngine::renderSceneToFrameBuffer(const EyeViews& views, const EyeViews& hud)
+{
+    // Draw scene into bound framebuffer, all of its layers.
     glViewport(0, 0, eye_w, eye_h);
     glClearColor(0.0, 0.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glCallList(*mList);
+    mWorld.draw(views);
     for (auto& client : mClients)
     {
-        if (client->getList())
-        {
-            glCallList(*client->getList());
-        }
-    }
-    {
-        if (mRenderedItems["crosshair_overlay"]) {
-            draw_crosshairs(0.1, x, y);
-        }
-        draw_hud(x - 0.35, y - 0.4);
+        client->draw(views);
     }
+
+    // hud over everything, in eye coordinates
+    glClear(GL_DEPTH_BUFFER_BIT);
+    mHud.draw(hud, 3.0f);
 }
 
 void RenderingEngine::renderLeftRightTextures()
 {
-    glUseProgram(shader);
-    // Draw left eye
-    glUniform2fv(glGetUniformLocation(shader, "LensCenter"), 1,
-                 left_lens_center);
-    glBindTexture(GL_TEXTURE_2D, left_color_tex);
-    glBegin(GL_QUADS);
-    glTexCoord2d(0, 0);
-    glVertex3d(-1, -1, 0);
-    glTexCoord2d(1, 0);
-    glVertex3d(0, -1, 0);
-    glTexCoord2d(1, 1);
-    glVertex3d(0, 1, 0);
-    glTexCoord2d(0, 1);
-    glVertex3d(-1, 1, 0);
-    glEnd();
-
-    // Draw right eye
-    glUniform2fv(glGetUniformLocation(shader, "LensCenter"), 1,
-                 right_lens_center);
-    glBindTexture(GL_TEXTURE_2D, right_color_tex);
-    glBegin(GL_QUADS);
-    glTexCoord2d(0, 0);
-    glVertex3d(0, -1, 0);
-    glTexCoord2d(1, 0);
-    glVertex3d(1, -1, 0);
-    glTexCoord2d(1, 1);
-    glVertex3d(1, 1, 0);
-    glTexCoord2d(0, 1);
-    glVertex3d(0, 1, 0);
-    glEnd();
-    glUseProgram(0);
+    // head turned since eyes were drawn, predicted to same display time
+    cl_float4 delta{0, 0, 0, 1};
+    if (mTimewarp)
+    {
+        auto latest = mPose.predict(mRenderedPose.time);
+        delta = quat_mult(quat_conj(mRenderedPose.rotation), latest.rotation);
+    }
+    // mesh follows lens adjustments, rebuilt only when they change
+    for (auto eye : {0, 1})
+    {
+        DistortionMesh::Lens lens{{viewport_scale[0], viewport_scale[1]},
+                                  {eye == 0 ? left_lens_center[0] : right_lens_center[0],
+                                   eye == 0 ? left_lens_center[1] : right_lens_center[1]},
+                                  warp_scale * warp_adj,
+                                  {distortion_coeffs[0], distortion_coeffs[1], distortion_coeffs[2], distortion_coeffs[3]},
+                                  {aberr_scale[0], aberr_scale[1], aberr_scale[2]}};
+        if (mDistortionOff)
+        {
+            std::fill(lens.coeffs, lens.coeffs + 3, 0.0f);
+            lens.coeffs[3] = 1.0f;
+        }
+        mDistortion.update(eye, lens);
+
+        GLfloat reproject[9];
+        DistortionMesh::reprojection(mRenderedProjection[eye], delta, reproject);
+        if (mStereo != Stereo::Single)
+        {
+            mDistortion.draw(eye, GL_TEXTURE_2D_ARRAY, stereo_color_tex, reproject);
+        } else
+        {
+            mDistortion.draw(eye, GL_TEXTURE_2D, eye == 0 ? left_color_tex : right_color_tex, reproject);
+        }
+    }
 }
 
 bool RenderingEngine::handleEvents()
@@ -228,6 +266,7 @@ void RenderingEngine::handleInput(SDL_Event& event)
                     float zero[] = {0, 0, 0, 1};
                     ohmd_device_setf(hmd, OHMD_ROTATION_QUAT, zero);
                     ohmd_device_setf(hmd, OHMD_POSITION_VECTOR, zero);
+                    mPose.reset();
                 }
                 break;
             case SDLK_F3:
@@ -264,19 +303,11 @@ void RenderingEngine::handleInput(SDL_Event& event)
             case SDLK_a:  // lense effect
                 {
                     warp_adj *= 1.0 / 0.9;
-                    glUseProgram(shader);
-                    glUniform1f(glGetUniformLocation(shader, "WarpScale"),
-                                warp_scale * warp_adj);
-                    glUseProgram(0);
                 }
                 break;
             case SDLK_z:
                 {
                     warp_adj *= 0.9;
-                    glUseProgram(shader);
-                    glUniform1f(glGetUniformLocation(shader, "WarpScale"),
-                                warp_scale * warp_adj);
-                    glUseProgram(0);
                 }
                 break;
             case SDLK_i:  // futher <-> near
@@ -296,17 +327,7 @@ void RenderingEngine::handleInput(SDL_Event& event)
                 }
                 break;
             case SDLK_d:
-                {
-                    static bool distorted{false};  // TODO:get it from shader
-                    float undistortion_coeffs[4] = {0.0, 0.0, 0.0, 1.0};
-
-                    glUseProgram(shader);
-                    glUniform4fv(glGetUniformLocation(shader, "HmdWarpParam"),
-                                 1, distorted ? distortion_coeffs : undistortion_coeffs);
-                    glUseProgram(0);
-
-                    distorted = !distorted;
-                }
+                mDistortionOff = !mDistortionOff;
                 break;
             case SDLK_x:
                 mRenderedItems["crosshair_overlay"] =
@@ -326,52 +347,44 @@ void RenderingEngine::run()
 {
     while (!mDone)
     {
+        // one pose for whole frame: upload priorities, gaze picking and
+        // both eyes; timewarp makes up for what head turns after this
+        latchPose();
+        auto rs0{rdtsc()};
+        for (auto& client : mClients)
+        {
+            client->frameStart(whereami, lookat, this);
+        }
+        handleEvents();
+        mCounters["render_scene_time"] = rdtsc() - rs0;
+
         // common scene state
         glEnable(GL_BLEND);
         glEnable(GL_DEPTH_TEST);
-        // get new rotation/position from hmd and use it to render
-        ohmd_ctx_update(omhdCtx);
-        // render
-        renderSceneToFrameBuffer(true);
-        renderSceneToFrameBuffer(false);
+        // render with pose latched above
+        renderEyes();
         // clean up common draw state
         glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
         glDisable(GL_BLEND);
         glDisable(GL_DEPTH_TEST);
 
-        // setup ortho state.
+        // eyes through lenses onto screen
         glViewport(0, 0, hmd_w, hmd_h);
-        glEnable(GL_TEXTURE_2D);
-        glColor4d(1, 1, 1, 1);
-        // setup simple render state
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        glMatrixMode(GL_MODELVIEW);
-        glLoadIdentity();
-        // textures
         renderLeftRightTextures();
-        // clean up state.
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glDisable(GL_TEXTURE_2D);
-
-
-        auto rs0{rdtsc()};
-        handleEvents();
 
-        mCounters["render_scene_time"] = rdtsc() - rs0;
         // Da swap-dawup!
         SDL_GL_SwapWindow(GlCtx.window);
+        mPose.presented();
 
         mCounters["fps"] = calculateFps();
     }
+    // uploads stop with rendering, clients free their GL objects on this
+    // thread once their own threads are gone
+    mUploader.reset();
 }
 
 RenderingEngine::~RenderingEngine()
 {
-    if (mList)
-    {
-        glDeleteLists(*mList, 1);
-    }
 }
 
 uint64_t RenderingEngine::calculateFps()
@@ -393,20 +406,16 @@ void RenderingEngine::draw_hud(const float x, const float y)
 {
     char text[64];
 
-    ohmd_device_getf(hmd, OHMD_ROTATION_QUAT, &mRotation.x);
-    cl_float4 forw{0, 0, -1, 0};
-    lookat = rotate_vertex_position(forw, mRotation);
-
     snprintf(text, sizeof(text),
              "Pos: %2.1f %2.1f %2.1f",
              whereami.x, whereami.y, whereami.z);
     draw_text(x, y, 0, 0.00015, text, true);
 
-    snprintf(text, sizeof(text), "RST: %3zd ms",
-             mCounters["render_scene_time"] / 1'000);
+    snprintf(text, sizeof(text), "RST: %3zd ms lead %2zd ms",
+             mCounters["render_scene_time"] / 1'000, mCounters["pose_lead"] / 1'000);
     draw_text(x, y - 0.12, 0, 0.00015, text, true);
 
-    snprintf(text, sizeof(text), "FPS: %3zd", mCounters["fps"]);
+    snprintf(text, sizeof(text), "FPS: %3zd %s", mCounters["fps"], EyeViews::name(mStereo));
     draw_text(x, y - 0.15, 0, 0.00015, text, true);
     for (auto& cli : mClients)
     {
@@ -417,57 +426,61 @@ void RenderingEngine::draw_hud(const float x, const float y)
 // Draws the 3D scene
 void RenderingEngine::generateScene()
 {
-    if (mList)
+    mWorld.clear();
+
+    cl_float4 color{0, 1.0f, .25f, .25f};
+    draw_text(-5, -5, +5, 0.002, "*LEFT,  DOWN, BACK", false, color);
+    draw_text(-5, +5, +5, 0.002, "*LEFT,  UP,   BACK", false, color);
+    draw_text(+5, +5, +5, 0.002, "*RIGHT, UP,   BACK", false, color);
+    draw_text(+5, -5, +5, 0.002, "*RIGHT, DOWN, BACK", false, color);
+    draw_text(-5, -5, -5, 0.002, "*LEFT,  DOWN, FRONT", false, color);
+    draw_text(-5, +5, -5, 0.002, "*LEFT,  UP,   FRONT", false, color);
+    draw_text(+5, +5, -5, 0.002, "*RIGHT, UP,   FRONT", false, color);
+    draw_text(+5, -5, -5, 0.002, "*RIGHT, DOWN, FRONT", false, color);
+}
+
+void RenderingEngine::draw_text(float x, float y, float z, float scale,
+                                const char* s, bool ui, cl_float4 color)
+{
+    auto& batch = ui ? mHud : mWorld;
+    auto point = [&](float px, float py)
     {
-        glDeleteLists(*mList, 1);
+        return VertexBatch::Vertex{x + px * scale, y + py * scale, z, 0, 0, color.x, color.y, color.z, color.w};
+    };
+    float advance{0};
+    for (auto i = 0u; i < strlen(s); ++i)
+    {
+        auto& g = glyph(s[i]);
+        for (size_t segment = 0; segment + 3 < g.segments.size(); segment += 4)
+        {
+            batch.line(point(advance + g.segments[segment], g.segments[segment + 1]),
+                       point(advance + g.segments[segment + 2], g.segments[segment + 3]));
+        }
+        advance += g.advance;
     }
+}
 
-    mList = glGenLists(1);
-    glNewList(*mList, GL_COMPILE);
-
-    glColor4f(0, 1.0f, .25f, .25f);
-
-    draw_text(-5, -5, +5, 0.002, "*LEFT,  DOWN, BACK");
-    draw_text(-5, +5, +5, 0.002, "*LEFT,  UP,   BACK");
-    draw_text(+5, +5, +5, 0.002, "*RIGHT, UP,   BACK");
-    draw_text(+5, -5, +5, 0.002, "*RIGHT, DOWN, BACK");
-    draw_text(-5, -5, -5, 0.002, "*LEFT,  DOWN, FRONT");
-    draw_text(-5, +5, -5, 0.002, "*LEFT,  UP,   FRONT");
-    draw_text(+5, +5, -5, 0.002, "*RIGHT, UP,   FRONT");
-    draw_text(+5, -5, -5, 0.002, "*RIGHT, DOWN, FRONT");
-
-    glEndList();
+void RenderingEngine::draw_image(float x, float y, float width, float height, GLuint texture)
+{
+    const VertexBatch::Vertex corners[4] = {
+        {x, y + height, 0, 0, 1, 1, 1, 1, 1},
+        {x, y, 0, 0, 0, 1, 1, 1, 1},
+        {x + width, y, 0, 1, 0, 1, 1, 1, 1},
+        {x + width, y + height, 0, 1, 1, 1, 1, 1, 1},
+    };
+    mHud.quad(corners, texture);
 }
 
-void RenderingEngine::draw_text(float x, float y, float z, float scale,
-                                const char* s, bool ui)
+const RenderingEngine::Glyph& RenderingEngine::glyph(char c)
 {
-    GLint org_line_width{1};
-    if (ui) {
-        glClear(GL_DEPTH_BUFFER_BIT);
-        glGetIntegerv(GL_LINE_WIDTH, &org_line_width);
-        glLineWidth(3);
-        glColor4f(1.0, 0.5, 0.0, 1.0);
-        glMatrixMode(GL_MODELVIEW);
-        glPushMatrix();
-        glLoadIdentity();
-        glMatrixMode(GL_PROJECTION);
-        glPushMatrix();
-        glLoadIdentity();
-    }    
-    glPushMatrix();
-    glTranslatef(x, y, z);
-    glScalef(scale, scale, scale);
-    for (auto i = 0u; i < strlen(s); ++i)
-        glutStrokeCharacter(GLUT_STROKE_ROMAN, s[i]);
-    glPopMatrix();
-    if (ui) {
-        glMatrixMode(GL_PROJECTION);
-        glPopMatrix();
-        glMatrixMode(GL_MODELVIEW);
-        glPopMatrix();
-        glLineWidth(org_line_width);
+    auto found = mGlyphs.find(c);
+    if (found != mGlyphs.end())
+    {
+        return found->second;
     }
+    Glyph glyph;
+    glyph.advance = strokeGlyph(c, glyph.segments);
+    return mGlyphs.emplace(c, std::move(glyph)).first->second;
 }
 
 cl_float4 RenderingEngine::quat_conj(cl_float4 q)
@@ -10,6 +10,11 @@
 #include "OpenGlWrap.h"
 #include "Client.h"
 #include "Xinput.h"
+#include "UploadThread.h"
+#include "VertexBatch.h"
+#include "EyeViews.h"
+#include "PoseProvider.h"
+#include "DistortionMesh.h"
 
 #define OVERSAMPLE_SCALE 2.0
 
@@ -19,27 +24,41 @@ class RenderingEngine : protected OpenHmdWrap, protected OpenGlWrap
 {
 public:
 
-    RenderingEngine(int argc, char** arg, std::vector<std::shared_ptr<Client> >& clients);
+    RenderingEngine(std::vector<std::shared_ptr<Client> >& clients);
     virtual ~RenderingEngine();
     void run();
+    // ui - in hud, x and y from -1 to 1 over eye view, world coordinates
+    // otherwise, only while scene is generated
     void draw_text(float x, float y, float z, float scale, const char* s,
-                   bool ui = false);
+                   bool ui = false, cl_float4 color = {1.0f, 0.5f, 0.0f, 1.0f});
+    // texture in hud, first texture row at y
+    void draw_image(float x, float y, float width, float height, GLuint texture);
     cl_float4 getRotation()
     {
         return mRotation;
     }
     // basic math
     cl_float4 rotate_vertex_position(cl_float4 q_pos, cl_float4 qr);
+    // texture transfers off the render thread, nullptr if no shared context
+    UploadThread* uploader()
+    {
+        return mUploader.get();
+    }
 private:
     void generateScene();
     void draw_hud(const float x, const float y);
     void draw_crosshairs(float len, float cx, float cy);
-    void renderSceneToFrameBuffer(bool leftEye);
+    // pose of this frame, for picking and both eyes
+    void latchPose();
+    // draws both eyes into left/right textures with latched pose
+    void renderEyes();
+    void renderSceneToFrameBuffer(const EyeViews& views, const EyeViews& hud);
     void renderLeftRightTextures();
     bool handleEvents();
     void handleInput(SDL_Event& event);
     uint64_t calculateFps();
     std::unique_ptr<Xinput> mXinput;
+    std::unique_ptr<UploadThread> mUploader;
 
 private:
     // hud related
@@ -49,8 +68,31 @@ private:
     cl_float4 lookat;
     cl_float4 whereami;
     cl_float4 mRotation;
+    // one predicted pose per frame, for both eyes and gaze
+    PoseProvider mPose;
+    // what eye textures were drawn with, distortion pass reprojects them
+    // to latest pose unless timewarp is off
+    PoseProvider::Pose mRenderedPose;
+    GLfloat mRenderedProjection[2][16];
+    bool mTimewarp;
+    // stroke font segments as x0 y0 x1 y1 in font units, once per character
+    struct Glyph
+    {
+        std::vector<GLfloat> segments;
+        GLfloat advance;
+    };
+    const Glyph& glyph(char c);
+    std::map<char, Glyph> mGlyphs;
+    // world labels, built once; hud, built each frame around lens center
+    VertexBatch mWorld;
+    VertexBatch mHud;
+    // final pass, both eye textures side by side through the lenses
+    DistortionMesh mDistortion;
+    // d key, lens distortion off to check calibration
+    bool mDistortionOff;
+    // how eyes are rasterized, both from one submission unless single
+    Stereo mStereo;
     // helpers
-    std::experimental::optional<GLuint> mList;
     uint64_t rdtsc();
     // basic math
     cl_float4 quat_conj(cl_float4 q);
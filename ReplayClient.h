@@ -0,0 +1,115 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+#include "XServerMirror.h"
+#include "CaptureFile.h"
+
+// Feeds recorded captures through the XServerMirror upload and scene
+// generation path. No X server is needed, so the upload and render cost can
+// be measured reproducibly.
+class ReplayClient : public XServerMirror
+{
+public:
+    ReplayClient(const std::string& fileName, bool maxSpeed,
+                 size_t cpuBudget, size_t gpuBudget)
+        : XServerMirror(cpuBudget, gpuBudget),
+          mReplay{fileName},
+          mMaxSpeed{maxSpeed}
+    {
+    }
+
+    bool run(RenderingEngine* renderingEngine, bool* exit)
+    {
+        (void)renderingEngine;
+        mThread = std::make_unique<std::thread>(&ReplayClient::replayFnc, this, exit);
+
+        return true;
+    }
+
+    // false if replay ran and no frame made it into a texture
+    bool join()
+    {
+        if (mThread && mThread->joinable())
+        {
+            mThread->join();
+        }
+        return !mFailed;
+    }
+
+    void* replayFnc(bool* exit)
+    {
+        auto start = std::chrono::steady_clock::now();
+        size_t bytes{0};
+        size_t i{0};
+        while (i < mReplay.size() && !*exit)
+        {
+            auto cycle = mReplay.frame(i).cycle;
+            if (!mMaxSpeed)
+            {
+                std::this_thread::sleep_until(start + std::chrono::microseconds(mReplay.frame(i).timestampUs));
+            }
+            for (; i < mReplay.size() && mReplay.frame(i).cycle == cycle; ++i)
+            {
+                auto& frame = mReplay.frame(i);
+                auto mirror = findOrAddMirror(frame.window);
+                // same as capture worker output
+                mirror->width = frame.width;
+                mirror->height = frame.height;
+                mirror->mImage.assign(mReplay.payload(i), mReplay.payload(i) + frame.payloadSize);
+                mirror->captureTime = std::chrono::steady_clock::now();
+                // recordings hold BGRA
+                mirror->contentHash = Mirror::hashCapture(mirror->mImage.data(), mirror->mImage.size(),
+                                                          frame.width, frame.height, false);
+                mBudget.setCpu(mirror.get(), mirror->mImage.capacity());
+                bytes += frame.payloadSize;
+                requestSceneGeneration(true, mirror.get());
+            }
+            requestSceneGeneration(false, nullptr);
+            if (!mRequestSceneGeneration.timed_wait(boost::get_system_time() + boost::posix_time::milliseconds(500)))
+            {
+                loge_ << "Server not responding\n";
+            }
+        }
+
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        logi_ << "replayed " << i << " frames, " << (bytes >> 20) << " MB in " << ms << " ms: "
+              << (ms ? i * 1000 / ms : 0) << " frames/s "
+              << (ms ? (bytes >> 20) * 1000 / ms : 0) << " MB/s, " << mUploaded << " uploaded\n";
+        // frames that never reach a texture make numbers above meaningless
+        mFailed = i > 0 && mUploaded == 0;
+        if (mFailed)
+        {
+            loge_ << "replay uploaded nothing\n";
+        }
+
+        return nullptr;
+    }
+
+private:
+    std::shared_ptr<Mirror> findOrAddMirror(uint64_t window)
+    {
+        auto mirror = find_if(mMasterList.begin(),
+                              mMasterList.end(),
+                              [&](auto& mirror)
+                              {
+                                  return mirror->window == window;
+                              });
+        if (mirror != mMasterList.end())
+        {
+            return *mirror;
+        }
+        // display stays null so worker never captures
+        mMasterList.push_back(std::make_shared<Mirror>());
+        mMasterList.back()->name = std::string("replay_") + std::to_string(window);
+        mMasterList.back()->window = window;
+        mMasterList.back()->budget = &mBudget;
+
+        return mMasterList.back();
+    }
+
+    CaptureReplay mReplay;
+    bool mMaxSpeed;
+    std::atomic<bool> mFailed{false};
+};
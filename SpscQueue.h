@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free bounded queue for exactly one producer and one consumer thread.
+// Neither side ever blocks, push fails when full and pop when empty.
+template<typename T, size_t N>
+class SpscQueue
+{
+public:
+    bool push(const T& item)
+    {
+        auto head = mHead.load(std::memory_order_relaxed);
+        auto next = (head + 1) % N;
+        if (next == mTail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        mItems[head] = item;
+        mHead.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        auto tail = mTail.load(std::memory_order_relaxed);
+        if (tail == mHead.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = mItems[tail];
+        mTail.store((tail + 1) % N, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, N> mItems;
+    alignas(64) std::atomic<size_t> mHead{0};
+    alignas(64) std::atomic<size_t> mTail{0};
+};
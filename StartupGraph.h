@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TypesConf.h"
+
+// Startup as a graph of tasks. Every task runs as soon as the tasks it
+// depends on are done, on its own thread, or on the thread calling run()
+// for work that has to stay there (GL context, SDL window).
+class StartupGraph
+{
+public:
+    // deps must name tasks added before
+    void add(const std::string& name, const std::vector<std::string>& deps,
+             std::function<void()> fn, bool onCaller = false)
+    {
+        Task task;
+        task.name = name;
+        task.fn = fn;
+        task.onCaller = onCaller;
+        for (auto& dep : deps)
+        {
+            auto index = find(dep);
+            if (index == mTasks.size())
+            {
+                throw Error("startup task " + name + " depends on unknown " + dep);
+            }
+            task.deps.push_back(index);
+        }
+        mTasks.push_back(task);
+    }
+
+    // returns when every task has finished, rethrows first failure
+    void run()
+    {
+        mStart = std::chrono::steady_clock::now();
+        std::vector<std::promise<void>> onCaller(mTasks.size());
+        for (size_t i = 0; i < mTasks.size(); ++i)
+        {
+            if (mTasks[i].onCaller)
+            {
+                mTasks[i].done = onCaller[i].get_future().share();
+            }
+        }
+        for (auto& task : mTasks)
+        {
+            if (!task.onCaller)
+            {
+                task.done = std::async(std::launch::async, [this, &task]() { execute(task); }).share();
+            }
+        }
+        for (size_t i = 0; i < mTasks.size(); ++i)
+        {
+            if (!mTasks[i].onCaller)
+            {
+                continue;
+            }
+            try
+            {
+                execute(mTasks[i]);
+                onCaller[i].set_value();
+            } catch (...)
+            {
+                onCaller[i].set_exception(std::current_exception());
+            }
+        }
+
+        std::exception_ptr failure;
+        for (auto& task : mTasks)
+        {
+            try
+            {
+                task.done.get();
+            } catch (...)
+            {
+                failure = failure ? failure : std::current_exception();
+            }
+        }
+        if (failure)
+        {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    // when each task started and finished, relative to run()
+    void report() const
+    {
+        auto ms = [this](std::chrono::steady_clock::time_point t)
+        {
+            return std::chrono::duration<double, std::milli>(t - mStart).count();
+        };
+        double total{0};
+        for (auto& task : mTasks)
+        {
+            total = std::max(total, ms(task.end));
+        }
+        std::cout << "startup took " << total << " ms\n";
+        for (auto& task : mTasks)
+        {
+            char line[128];
+            auto from = static_cast<int>(40 * ms(task.start) / std::max(total, 1.0));
+            auto to = static_cast<int>(40 * ms(task.end) / std::max(total, 1.0));
+            snprintf(line, sizeof(line), "%-10s %8.1f %8.1f ms |%*s%s", task.name.c_str(),
+                     ms(task.start), ms(task.end), from, "",
+                     std::string(std::max(to - from, 1), '#').c_str());
+            std::cout << line << "\n";
+        }
+    }
+
+private:
+    struct Task
+    {
+        std::string name;
+        std::vector<size_t> deps;
+        std::function<void()> fn;
+        bool onCaller{false};
+        std::shared_future<void> done;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+    };
+
+    size_t find(const std::string& name) const
+    {
+        for (size_t i = 0; i < mTasks.size(); ++i)
+        {
+            if (mTasks[i].name == name)
+            {
+                return i;
+            }
+        }
+        return mTasks.size();
+    }
+
+    // failed dependency fails the task without running it
+    void execute(Task& task)
+    {
+        try
+        {
+            for (auto dep : task.deps)
+            {
+                mTasks[dep].done.get();
+            }
+        } catch (...)
+        {
+            task.start = task.end = std::chrono::steady_clock::now();
+            throw;
+        }
+        task.start = std::chrono::steady_clock::now();
+        try
+        {
+            task.fn();
+        } catch (...)
+        {
+            task.end = std::chrono::steady_clock::now();
+            throw;
+        }
+        task.end = std::chrono::steady_clock::now();
+    }
+
+    std::vector<Task> mTasks;
+    std::chrono::steady_clock::time_point mStart;
+};
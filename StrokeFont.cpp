@@ -0,0 +1,142 @@
+#include <string.h>
+
+#include "StrokeFont.h"
+
+namespace
+{
+
+// printable ASCII from ' ', polylines separated by spaces, points are digit
+// pairs x 0..4, y 0..8 with baseline at 2, x-height 6 and capitals 8
+const char* const kStrokes[] = {
+    "",                             // ' '
+    "2824 2322",                    // !
+    "1817 3837",                    // "
+    "1317 3337 0444 0646",          // #
+    "48180706153544433202 2921",    // $
+    "0248 0807 4243",               // %
+    "42051727360403122244",         // &
+    "2827",                         // '
+    "38262432",                     // (
+    "18363412",                     // )
+    "2723 0644 0446",               // *
+    "2723 0545",                    // +
+    "2311",                         // ,
+    "0545",                         // -
+    "2322",                         // .
+    "0248",                         // /
+    "0802424808 0248",              // 0
+    "172822 0242",                  // 1
+    "084845050242",                 // 2
+    "08484202 0545",                // 3
+    "080545 4842",                  // 4
+    "4808063645433202",             // 5
+    "480802424505",                 // 6
+    "084842",                       // 7
+    "0802424808 0545",              // 8
+    "450508484202",                 // 9
+    "2625 2322",                    // :
+    "2625 2311",                    // ;
+    "470542",                       // <
+    "0444 0646",                    // =
+    "074502",                       // >
+    "071838474624 2322",            // ?
+    "341415354548080242",           // @
+    "022842 1535",                  // A
+    "02083847463505 3544433202",    // B
+    "48080242",                     // C
+    "02083847433202",               // D
+    "48080242 0535",                // E
+    "480802 0535",                  // F
+    "480802424525",                 // G
+    "0208 4842 0545",               // H
+    "0848 2822 0242",               // I
+    "4843321203",                   // J
+    "0208 480542",                  // K
+    "080242",                       // L
+    "0208254842",                   // M
+    "02084248",                     // N
+    "0802424808",                   // O
+    "0208484505",                   // P
+    "0802424808 2441",              // Q
+    "0208484505 2542",              // R
+    "48180706153544433202",         // S
+    "0848 2822",                    // T
+    "08024248",                     // U
+    "082248",                       // V
+    "0802254248",                   // W
+    "0842 0248",                    // X
+    "082548 2522",                  // Y
+    "08480242",                     // Z
+    "38181232",                     // [
+    "0842",                         // backslash
+    "18383212",                     // ]
+    "062846",                       // ^
+    "0141",                         // _
+    "1827",                         // `
+    "064642020444",                 // a
+    "0802424505",                   // b
+    "46060242",                     // c
+    "4842020545",                   // d
+    "044446060242",                 // e
+    "482822 0636",                  // f
+    "420206464000",                 // g
+    "0802 064642",                  // h
+    "2622 2728",                    // i
+    "262000 2728",                  // j
+    "0802 460442",                  // k
+    "2822",                         // l
+    "02064642 2622",                // m
+    "02064642",                     // n
+    "0602424606",                   // o
+    "0006464202",                   // p
+    "4046060242",                   // q
+    "0206 051646",                  // r
+    "460604444202",                 // s
+    "282242 0636",                  // t
+    "06024246",                     // u
+    "062246",                       // v
+    "0602244246",                   // w
+    "0642 0246",                    // x
+    "0623 4600",                    // y
+    "06460242",                     // z
+    "38282615242232",               // {
+    "2821",                         // |
+    "18282635242212",               // }
+    "05163445",                     // ~
+};
+static_assert(sizeof(kStrokes) / sizeof(kStrokes[0]) == '~' - ' ' + 1, "one entry per printable character");
+
+// one grid step, capitals come out 120 high
+const float kUnit{20};
+const float kAdvance{110};
+
+}
+
+float strokeGlyph(char c, std::vector<float>& segments)
+{
+    segments.clear();
+    if (c < ' ' || c > '~')
+    {
+        c = '?';
+    }
+    auto strokes = kStrokes[c - ' '];
+    auto length = strlen(strokes);
+    for (size_t i = 0; i + 1 < length; i += 2)
+    {
+        if (strokes[i] == ' ')
+        {
+            // pen up, next polyline starts at following point
+            --i;
+            continue;
+        }
+        if (i + 3 < length && strokes[i + 2] != ' ')
+        {
+            for (auto k = 0; k < 4; ++k)
+            {
+                auto value = (strokes[i + k] - '0') * kUnit;
+                segments.push_back(k % 2 ? value - 2 * kUnit : value);
+            }
+        }
+    }
+    return kAdvance;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <vector>
+
+// Stroke font for world labels and hud, plain line segments that go to
+// VertexBatch like everything else. Glyphs are drawn on a small grid, sizes
+// are close to glut roman so text scales picked for it still fit.
+
+// line segments of c as x0 y0 x1 y1 in font units, baseline at 0; returns
+// how far pen moves. Characters outside printable ASCII come out as '?'.
+float strokeGlyph(char c, std::vector<float>& segments);
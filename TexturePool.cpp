@@ -0,0 +1,330 @@
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "TexturePool.h"
+
+TexturePool::TexturePool(size_t idleCeiling)
+    : mIdleBytes{0},
+      mIdleCeiling{idleCeiling},
+      mMipFbo{0, 0}
+{
+}
+
+size_t TexturePool::sizeClass(size_t n)
+{
+    // 1/8 headroom, rounded to 64 pixels
+    return (n + n / 8 + 63) / 64 * 64;
+}
+
+size_t TexturePool::cellSize(size_t n)
+{
+    size_t cell{64};
+    while (cell < n)
+    {
+        cell *= 2;
+    }
+    return cell;
+}
+
+bool TexturePool::small(size_t width, size_t height)
+{
+    return width <= kMaxCell && height <= kMaxCell;
+}
+
+bool TexturePool::fits(const Texture& texture, size_t width, size_t height, bool compact)
+{
+    if (!texture || texture.compressed || texture.compact != compact || texture.atlas != small(width, height))
+    {
+        return false;
+    }
+    if (texture.atlas)
+    {
+        return texture.width == cellSize(width) && texture.height == cellSize(height);
+    }
+    auto fit = [](size_t have, size_t need)
+    {
+        return need <= have && have <= sizeClass(need) * 3 / 2;
+    };
+    return fit(texture.width, width) && fit(texture.height, height);
+}
+
+// down to a few pixels per cell for atlas pages, to 1x1 otherwise
+GLint TexturePool::levelsFor(size_t width, size_t height, bool atlas)
+{
+    if (!GLEW_ARB_framebuffer_object)
+    {
+        // levels are built by blits
+        return 1;
+    }
+    auto smallest = std::min(width, height);
+    GLint levels{1};
+    while ((smallest >>= 1) >= (atlas ? 4u : 1u))
+    {
+        ++levels;
+    }
+    return levels;
+}
+
+GLuint TexturePool::create(size_t width, size_t height, GLint levels, bool compact)
+{
+    GLuint name;
+    glGenTextures(1, &name);
+    glBindTexture(GL_TEXTURE_2D, name);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    if (GLEW_EXT_texture_filter_anisotropic)
+    {
+        GLfloat anisotropy{1.0f};
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(anisotropy, 8.0f));
+    }
+    for (GLint level = 0; level < levels; ++level)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, compact ? GL_RGB565 : GL_RGBA8, std::max<size_t>(width >> level, 1),
+                     std::max<size_t>(height >> level, 1), 0, compact ? GL_RGB : GL_BGRA,
+                     compact ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return name;
+}
+
+TexturePool::Texture TexturePool::acquire(size_t width, size_t height, GLuint near, bool compact)
+{
+    if (small(width, height))
+    {
+        return acquireCell(width, height, near, compact);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMtx);
+        for (auto texture = mIdle.begin(); texture != mIdle.end(); ++texture)
+        {
+            if (fits(*texture, width, height, compact))
+            {
+                auto found = *texture;
+                mIdleBytes -= found.bytes();
+                mIdle.erase(texture);
+                return found;
+            }
+        }
+    }
+
+    Texture texture;
+    texture.width = texture.textureWidth = sizeClass(width);
+    texture.height = texture.textureHeight = sizeClass(height);
+    texture.levels = levelsFor(texture.width, texture.height, false);
+    texture.compact = compact;
+    texture.name = create(texture.width, texture.height, texture.levels, compact);
+    return texture;
+}
+
+TexturePool::Texture TexturePool::acquireCell(size_t width, size_t height, GLuint near, bool compact)
+{
+    Texture texture;
+    texture.width = cellSize(width);
+    texture.height = cellSize(height);
+    texture.textureWidth = texture.width * kCellsPerSide;
+    texture.textureHeight = texture.height * kCellsPerSide;
+    texture.atlas = true;
+    texture.levels = levelsFor(texture.width, texture.height, true);
+    texture.compact = compact;
+
+    std::lock_guard<std::mutex> lock(mMtx);
+    Page* page{nullptr};
+    for (auto& candidate : mPages)
+    {
+        if (candidate.cellWidth != texture.width || candidate.cellHeight != texture.height ||
+            candidate.compact != compact || candidate.usedCount == candidate.used.size())
+        {
+            continue;
+        }
+        if (page == nullptr || candidate.name == near)
+        {
+            page = &candidate;
+        }
+    }
+    if (page == nullptr)
+    {
+        Page created;
+        created.name = create(texture.textureWidth, texture.textureHeight, texture.levels, compact);
+        created.cellWidth = texture.width;
+        created.cellHeight = texture.height;
+        created.compact = compact;
+        created.used.resize(kCellsPerSide * kCellsPerSide, false);
+        mPages.push_back(created);
+        page = &mPages.back();
+    }
+    size_t cell{0};
+    while (page->used[cell])
+    {
+        ++cell;
+    }
+    page->used[cell] = true;
+    ++page->usedCount;
+    texture.name = page->name;
+    texture.x = cell % kCellsPerSide * texture.width;
+    texture.y = cell / kCellsPerSide * texture.height;
+    return texture;
+}
+
+void TexturePool::releaseCell(const Texture& texture)
+{
+    for (auto page = mPages.begin(); page != mPages.end(); ++page)
+    {
+        if (page->name != texture.name)
+        {
+            continue;
+        }
+        auto cell = texture.y / texture.height * kCellsPerSide + texture.x / texture.width;
+        page->used[cell] = false;
+        if (--page->usedCount == 0)
+        {
+            glDeleteTextures(1, &page->name);
+            mPages.erase(page);
+        }
+        return;
+    }
+}
+
+void TexturePool::release(Texture& texture)
+{
+    if (!texture)
+    {
+        return;
+    }
+    if (texture.compressed)
+    {
+        glDeleteTextures(1, &texture.name);
+        texture = Texture();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMtx);
+    if (texture.atlas)
+    {
+        releaseCell(texture);
+        texture = Texture();
+        return;
+    }
+    mIdle.push_back(texture);
+    mIdleBytes += texture.bytes();
+    texture = Texture();
+    while (mIdleBytes > mIdleCeiling)
+    {
+        mIdleBytes -= mIdle.front().bytes();
+        glDeleteTextures(1, &mIdle.front().name);
+        mIdle.pop_front();
+    }
+}
+
+bool TexturePool::compactSupported()
+{
+    // sized RGB565 came with ES2 compatibility
+    return GLEW_ARB_ES2_compatibility;
+}
+
+bool TexturePool::bc1Supported()
+{
+    return GLEW_EXT_texture_compression_s3tc;
+}
+
+TexturePool::Texture TexturePool::createBc1(const uint8_t* blocks, size_t size, size_t width, size_t height)
+{
+    Texture texture;
+    // blocks cover partial ones at edges
+    texture.width = texture.textureWidth = (width + 3) / 4 * 4;
+    texture.height = texture.textureHeight = (height + 3) / 4 * 4;
+    texture.compressed = true;
+    glGenTextures(1, &texture.name);
+    glBindTexture(GL_TEXTURE_2D, texture.name);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    if (GLEW_EXT_texture_filter_anisotropic)
+    {
+        GLfloat anisotropy{1.0f};
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(anisotropy, 8.0f));
+    }
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                           texture.width, texture.height, 0, size, blocks);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+void TexturePool::updateMipmaps(const Texture& texture, size_t width, size_t height)
+{
+    if (texture.levels < 2)
+    {
+        return;
+    }
+    if (mMipFbo[0] == 0)
+    {
+        glGenFramebuffers(2, mMipFbo);
+    }
+    // slack right of and below window is whatever earlier tenants or a
+    // larger window left, texels filtering near edges may reach are cleared
+    const size_t kSlack{4};
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    glClearColor(0, 0, 0, 0);
+    // glGenerateMipmap would redo whole atlas page, blit just this part
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, mMipFbo[0]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mMipFbo[1]);
+    auto w = width;
+    auto h = height;
+    for (GLint level = 0; level < texture.levels; ++level)
+    {
+        auto x = texture.x >> level;
+        auto y = texture.y >> level;
+        auto partWidth = std::max<size_t>(texture.width >> level, 1);
+        auto partHeight = std::max<size_t>(texture.height >> level, 1);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.name, level);
+        glEnable(GL_SCISSOR_TEST);
+        if (w < partWidth)
+        {
+            glScissor(x + w, y, std::min(kSlack, partWidth - w), std::min(h + kSlack, partHeight));
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+        if (h < partHeight)
+        {
+            glScissor(x, y + h, std::min(w + kSlack, partWidth), std::min(kSlack, partHeight - h));
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+        glDisable(GL_SCISSOR_TEST);
+        if (level + 1 == texture.levels)
+        {
+            break;
+        }
+
+        // odd sizes round up so last row and column make it down
+        auto nextWidth = std::min(std::max<size_t>((w + 1) / 2, 1), std::max<size_t>(partWidth / 2, 1));
+        auto nextHeight = std::min(std::max<size_t>((h + 1) / 2, 1), std::max<size_t>(partHeight / 2, 1));
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.name, level);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.name, level + 1);
+        glBlitFramebuffer(x, y, x + w, y + h,
+                          x / 2, y / 2, x / 2 + nextWidth, y / 2 + nextHeight,
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        w = nextWidth;
+        h = nextHeight;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+}
+
+size_t TexturePool::idleBytes() const
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    return mIdleBytes;
+}
+
+size_t TexturePool::atlasPages() const
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    return mPages.size();
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include <GL/gl.h>
+
+// Window textures come from here. They are allocated a size class larger than
+// asked for, a window drawn from the top left sub rectangle keeps its texture
+// while being resized within it, and textures of closed or resized windows
+// are handed to the next window that fits instead of being deleted.
+//
+// Small windows do not get a texture of their own but a cell of an atlas
+// page, pages are cut into 4x4 cells of one power of two size, so a handful
+// of terminals share one texture and one bind.
+//
+// Windows in background may get RGB565 textures, half of RGBA8, they are
+// pooled and paged apart from RGBA8 ones.
+//
+// Textures carry mip chains sampled trilinear and anisotropic, atlas chains
+// stop while cells are still a few pixels so neighbours do not bleed in.
+//
+// Any thread with a context sharing objects may call it, updateMipmaps() only
+// the thread that uploads.
+class TexturePool
+{
+public:
+    struct Texture
+    {
+        GLuint name{0};
+        // where window goes in texture and how much of it it may use,
+        // content may be smaller
+        size_t x{0};
+        size_t y{0};
+        size_t width{0};
+        size_t height{0};
+        // whole texture, larger than width x height for atlas cells
+        size_t textureWidth{0};
+        size_t textureHeight{0};
+        bool atlas{false};
+        GLint levels{1};
+        // BC1 texture of static window, not pooled, never written again
+        bool compressed{false};
+        // RGB565, no alpha
+        bool compact{false};
+
+        explicit operator bool() const { return name != 0; }
+        // mip chain adds a third
+        size_t bytes() const { return width * height * (compressed ? 1 : (compact ? 4 : 8)) * (levels > 1 ? 4 : 3) / 6; }
+        // what pixels uploaded to it look like
+        GLenum format() const { return compact ? GL_RGB : GL_BGRA; }
+        GLenum type() const { return compact ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE; }
+        size_t pixelBytes() const { return compact ? 2 : 4; }
+    };
+
+    // idle bytes kept for reuse, oldest go first above that
+    // idle textures go with the GL context, they are not deleted here
+    explicit TexturePool(size_t idleCeiling = 64 << 20);
+
+    // rounds up with some headroom for growth
+    static size_t sizeClass(size_t n);
+    // true if texture can hold width x height in given format without
+    // wasting too much
+    static bool fits(const Texture& texture, size_t width, size_t height, bool compact = false);
+
+    // RGBA, or RGB565 if compact, texture holding at least width x height,
+    // content undefined
+    // near - atlas page preferred for a cell, keeps front and back together
+    Texture acquire(size_t width, size_t height, GLuint near = 0, bool compact = false);
+    void release(Texture& texture);
+    // true if the GL driver takes RGB565 textures
+    static bool compactSupported();
+    // true if the GL driver takes BC1 textures
+    static bool bc1Supported();
+    // texture from BC1 blocks of width x height image
+    static Texture createBc1(const uint8_t* blocks, size_t size, size_t width, size_t height);
+    // rebuild mip levels below width x height at top left of texture part
+    // from level 0, only that region and a few cleared texels of slack next
+    // to it, in every level, are touched
+    void updateMipmaps(const Texture& texture, size_t width, size_t height);
+
+    size_t idleBytes() const;
+    size_t atlasPages() const;
+
+private:
+    struct Page
+    {
+        GLuint name{0};
+        size_t cellWidth{0};
+        size_t cellHeight{0};
+        std::vector<bool> used;
+        size_t usedCount{0};
+        bool compact{false};
+    };
+    // windows up to this size in both directions go to atlas
+    static const size_t kMaxCell{512};
+    static const size_t kCellsPerSide{4};
+    static size_t cellSize(size_t n);
+    static bool small(size_t width, size_t height);
+    static GLint levelsFor(size_t width, size_t height, bool atlas);
+    static GLuint create(size_t width, size_t height, GLint levels, bool compact);
+
+    Texture acquireCell(size_t width, size_t height, GLuint near, bool compact);
+    void releaseCell(const Texture& texture);
+
+    std::list<Texture> mIdle;
+    size_t mIdleBytes;
+    size_t mIdleCeiling;
+    std::list<Page> mPages;
+    // framebuffers blitting one level to next, belong to uploading context
+    GLuint mMipFbo[2];
+    mutable std::mutex mMtx;
+};
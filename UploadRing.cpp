@@ -0,0 +1,133 @@
+#include <GL/glew.h>
+
+#include "UploadRing.h"
+#include "TypesConf.h"
+
+bool UploadRing::supported()
+{
+    return GLEW_ARB_buffer_storage && GLEW_ARB_sync;
+}
+
+UploadRing::UploadRing(size_t slotSize, size_t slots)
+    : mSlotSize{slotSize},
+      mSlots{slots},
+      mBuffer{0},
+      mPtr{nullptr},
+      mState{new std::atomic<int>[slots]},
+      mSeq{new std::atomic<uint64_t>[slots]},
+      mNextSeq{1},
+      mTags(slots, 0),
+      mFences(slots, nullptr)
+{
+    auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &mBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes(), nullptr, flags);
+    mPtr = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes(), flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (mPtr == nullptr)
+    {
+        glDeleteBuffers(1, &mBuffer);
+        throw Error("failed to map upload ring");
+    }
+    for (size_t i = 0; i < mSlots; ++i)
+    {
+        mState[i] = FREE;
+        mSeq[i] = 0;
+    }
+}
+
+UploadRing::~UploadRing()
+{
+    for (auto fence : mFences)
+    {
+        if (fence != nullptr)
+        {
+            glDeleteSync(fence);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &mBuffer);
+}
+
+int UploadRing::acquire()
+{
+    for (size_t i = 0; i < mSlots; ++i)
+    {
+        int expected{FREE};
+        if (mState[i].compare_exchange_strong(expected, WRITING))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void UploadRing::commit(int slot, uint32_t tag)
+{
+    mTags[slot] = tag;
+    mSeq[slot] = mNextSeq++;
+    mState[slot] = READY;
+}
+
+void UploadRing::cancel(int slot)
+{
+    mState[slot] = FREE;
+}
+
+int UploadRing::latest()
+{
+    auto newest{-1};
+    for (size_t i = 0; i < mSlots; ++i)
+    {
+        if (mState[i] == READY && (newest < 0 || mSeq[i] > mSeq[newest]))
+        {
+            newest = i;
+        }
+    }
+    // frames overtaken by newer one are never shown
+    for (size_t i = 0; i < mSlots; ++i)
+    {
+        if (int(i) != newest && mState[i] == READY && mSeq[i] < mSeq[newest])
+        {
+            mState[i] = FREE;
+        }
+    }
+    return newest;
+}
+
+void UploadRing::pin(int slot)
+{
+    // retire() leaves reading slots without fence alone
+    mState[slot] = READING;
+}
+
+void UploadRing::fence(int slot)
+{
+    if (mFences[slot] != nullptr)
+    {
+        glDeleteSync(mFences[slot]);
+    }
+    mFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mState[slot] = READING;
+}
+
+void UploadRing::retire()
+{
+    for (size_t i = 0; i < mSlots; ++i)
+    {
+        if (mState[i] != READING || mFences[i] == nullptr)
+        {
+            continue;
+        }
+        auto status = glClientWaitSync(mFences[i], 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync(mFences[i]);
+            mFences[i] = nullptr;
+            mState[i] = FREE;
+        }
+    }
+}
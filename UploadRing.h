@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+// Pixel unpack buffer cut into slots and mapped once for its whole life
+// (ARB_buffer_storage, persistent + coherent), so capture threads write frames
+// while the GPU still reads older ones. A fence per slot tells when the GPU is
+// done with it, nothing ever waits on it.
+//
+// Constructor, destructor, latest(), pin(), fence() and retire() need the
+// opengl thread, acquire(), data(), commit() and cancel() may be called from any.
+class UploadRing
+{
+public:
+    // true if driver has what persistent mapping needs
+    static bool supported();
+
+    UploadRing(size_t slotSize, size_t slots = 3);
+    ~UploadRing();
+
+    // free slot to write a frame into or -1, never waits
+    int acquire();
+    uint8_t* data(int slot) { return mPtr + slot * mSlotSize; }
+    // frame in slot is complete, tag says what kind of frame for reader
+    void commit(int slot, uint32_t tag = 0);
+    void cancel(int slot);
+
+    // newest complete slot or -1, older complete ones are dropped
+    int latest();
+    uint32_t tag(int slot) const { return mTags[slot]; }
+    // offset to pass as pixels while buffer is bound to GL_PIXEL_UNPACK_BUFFER
+    const void* offset(int slot) const { return reinterpret_cast<const void*>(slot * mSlotSize); }
+    // keep slot from being dropped or reused while it is read in parts,
+    // fence() lets it go
+    void pin(int slot);
+    // GPU reads slot from now on, slot is free once commands so far are done
+    void fence(int slot);
+    // free slots the GPU is done with
+    void retire();
+
+    GLuint buffer() const { return mBuffer; }
+    size_t slotSize() const { return mSlotSize; }
+    size_t bytes() const { return mSlotSize * mSlots; }
+
+private:
+    enum State
+    {
+        FREE,
+        WRITING,
+        READY,
+        READING
+    };
+
+    size_t mSlotSize;
+    size_t mSlots;
+    GLuint mBuffer;
+    uint8_t* mPtr;
+    std::unique_ptr<std::atomic<int>[]> mState;
+    // commit order, latest() picks the highest
+    std::unique_ptr<std::atomic<uint64_t>[]> mSeq;
+    std::atomic<uint64_t> mNextSeq;
+    // written before slot goes READY
+    std::vector<uint32_t> mTags;
+    std::vector<GLsync> mFences;
+};
@@ -0,0 +1,127 @@
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "UploadScheduler.h"
+
+namespace
+{
+// bands are at least this high, so a frame always moves on
+const size_t kBandRows{32};
+const size_t kMinBudget{256 << 10};
+const size_t kMaxBudget{64 << 20};
+}
+
+UploadScheduler::UploadScheduler(uint64_t frameNs)
+    : mFrameNs{frameNs},
+      // about 4 GB/s until first measurement is in
+      mNsPerByte{0.25}
+{
+}
+
+void UploadScheduler::submit(Key key, size_t rowBytes, size_t rows)
+{
+    if (rowBytes == 0 || rows == 0)
+    {
+        return;
+    }
+    auto& entry = mEntries[key];
+    entry.rowBytes = rowBytes;
+    entry.rows = rows;
+    entry.row = 0;
+}
+
+void UploadScheduler::touch(Key key, bool focus, float gaze, bool busy)
+{
+    auto entry = mEntries.find(key);
+    if (entry != mEntries.end())
+    {
+        entry->second.focus = focus;
+        entry->second.gaze = gaze;
+        entry->second.busy = busy;
+    }
+}
+
+void UploadScheduler::remove(Key key)
+{
+    mEntries.erase(key);
+}
+
+double UploadScheduler::priority(const Entry& entry, std::chrono::steady_clock::time_point now)
+{
+    auto waitMs = std::chrono::duration<double, std::milli>(now - entry.since).count();
+    return (entry.focus ? 1000.0 : 0.0) + 500.0 * std::max(entry.gaze, 0.0f) + waitMs;
+}
+
+std::vector<UploadScheduler::Band> UploadScheduler::schedule()
+{
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::pair<double, Key>> order;
+    for (auto& entry : mEntries)
+    {
+        if (!entry.second.busy && entry.second.rows != 0)
+        {
+            order.emplace_back(priority(entry.second, now), entry.first);
+        }
+    }
+    std::sort(order.begin(), order.end(), [](auto& a, auto& b) { return a.first > b.first; });
+
+    std::vector<Band> bands;
+    auto left = budget();
+    for (auto& item : order)
+    {
+        auto& entry = mEntries[item.second];
+        auto rows = entry.rows - entry.row;
+        if (entry.rowBytes * rows > left)
+        {
+            rows = entry.rowBytes > 0 ? left / entry.rowBytes / kBandRows * kBandRows : rows;
+            if (rows == 0 && bands.empty())
+            {
+                rows = std::min(kBandRows, entry.rows - entry.row);
+            }
+        }
+        if (rows == 0)
+        {
+            // maybe a smaller one still fits
+            continue;
+        }
+        Band band{item.second, entry.row, rows, entry.row + rows == entry.rows};
+        bands.push_back(band);
+        left -= std::min(left, entry.rowBytes * rows);
+        entry.row += rows;
+        if (band.last)
+        {
+            // key stays with its focus and gaze, staleness starts over
+            entry.rows = 0;
+            entry.row = 0;
+            entry.since = now;
+        }
+    }
+    return bands;
+}
+
+void UploadScheduler::measured(size_t bytes, uint64_t ns)
+{
+    if (bytes == 0)
+    {
+        return;
+    }
+    auto sample = static_cast<double>(ns) / bytes;
+    mNsPerByte = (mNsPerByte * 7 + sample) / 8;
+}
+
+bool UploadScheduler::timerSupported()
+{
+    return GLEW_ARB_timer_query;
+}
+
+size_t UploadScheduler::pending() const
+{
+    return std::count_if(mEntries.begin(), mEntries.end(), [](auto& entry) { return entry.second.rows != 0; });
+}
+
+size_t UploadScheduler::budget() const
+{
+    auto bytes = static_cast<size_t>(mFrameNs / std::max(mNsPerByte.load(), 1e-6));
+    return std::min(std::max(bytes, kMinBudget), kMaxBudget);
+}
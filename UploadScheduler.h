@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <vector>
+
+// Decides what gets uploaded in a frame. Bytes per frame are capped by what
+// the GPU managed in the time given to uploads (fed from timer queries),
+// frames that do not fit are cut into row bands and finished in later frames.
+// Focused window goes first, then what is looked at, windows climb up with
+// time since their last frame went up so nothing starves.
+//
+// Everything except measured() belongs to the opengl thread.
+class UploadScheduler
+{
+public:
+    typedef const void* Key;
+
+    struct Band
+    {
+        Key key;
+        size_t row;
+        size_t rows;
+        // frame is complete after this band
+        bool last;
+    };
+
+    // frameNs - GPU time per frame given to uploads
+    explicit UploadScheduler(uint64_t frameNs = 2'000'000);
+
+    // newer frame replaces the one waiting for key, its bands start over
+    void submit(Key key, size_t rowBytes, size_t rows);
+    // refresh priority inputs, gaze is cos of angle to where we look,
+    // busy entries are not scheduled
+    void touch(Key key, bool focus, float gaze, bool busy);
+    void remove(Key key);
+
+    // bands to upload this frame, highest priority first
+    std::vector<Band> schedule();
+
+    // any thread, GPU time taken by an upload of bytes
+    void measured(size_t bytes, uint64_t ns);
+    // true if driver has GL_TIME_ELAPSED queries to measure with
+    static bool timerSupported();
+
+    size_t budget() const;
+    // frames waiting
+    size_t pending() const;
+
+private:
+    struct Entry
+    {
+        size_t rowBytes{0};
+        // 0 while no frame waits
+        size_t rows{0};
+        // first row not uploaded yet
+        size_t row{0};
+        bool focus{false};
+        float gaze{0};
+        bool busy{false};
+        // since when key shows stale content, last finished frame
+        std::chrono::steady_clock::time_point since{std::chrono::steady_clock::now()};
+    };
+    static double priority(const Entry& entry, std::chrono::steady_clock::time_point now);
+
+    uint64_t mFrameNs;
+    // EWMA of GPU cost
+    std::atomic<double> mNsPerByte;
+    std::map<Key, Entry> mEntries;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <SDL2/SDL.h>
+
+#include "TypesConf.h"
+
+// Runs texture transfers on its own thread with a GL context shared with
+// the render context, so textures and buffers are visible to both. Jobs run
+// in the order they were posted.
+class UploadThread
+{
+public:
+    UploadThread(SDL_Window* window, SDL_GLContext context)
+        : mWindow{window},
+          mContext{context},
+          mExit{false}
+    {
+        mThread = std::make_unique<std::thread>(&UploadThread::thrFnc, this);
+    }
+
+    ~UploadThread()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMtx);
+            mExit = true;
+        }
+        mCv.notify_one();
+        mThread->join();
+    }
+
+    void post(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMtx);
+            mJobs.push_back(std::move(job));
+        }
+        mCv.notify_one();
+    }
+
+private:
+    void thrFnc()
+    {
+        if (SDL_GL_MakeCurrent(mWindow, mContext) != 0)
+        {
+            loge_ << "upload context not current, uploads will fail\n";
+        }
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mMtx);
+                mCv.wait(lock, [this]() { return mExit || !mJobs.empty(); });
+                if (mExit)
+                {
+                    break;
+                }
+                job = std::move(mJobs.front());
+                mJobs.pop_front();
+            }
+            job();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mMtx);
+            mJobs.clear();
+        }
+        SDL_GL_MakeCurrent(mWindow, nullptr);
+        logi_ << "Upload thread exited\n";
+    }
+
+    SDL_Window* mWindow;
+    SDL_GLContext mContext;
+    bool mExit;
+    std::deque<std::function<void()>> mJobs;
+    std::mutex mMtx;
+    std::condition_variable mCv;
+    std::unique_ptr<std::thread> mThread;
+};
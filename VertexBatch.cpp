@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+#include <GL/glew.h>
+
+#include "VertexBatch.h"
+#include "OpenGlWrap.h"
+#include "EyeViews.h"
+
+namespace
+{
+
+// after EyeViews::vertexPrologue
+const char* kVertexShader = R"(
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 texCoord;
+layout(location = 2) in vec4 color;
+uniform mat4 projection[2];
+uniform mat4 modelview[2];
+out vec2 uv;
+out vec4 tint;
+void main()
+{
+    uv = texCoord;
+    tint = color;
+    gl_Position = projection[EYE] * modelview[EYE] * vec4(position, 1.0);
+    STEREO_LAYER
+}
+)";
+
+const char* kFragmentShader = R"(#version 330
+uniform sampler2D image;
+in vec2 uv;
+in vec4 tint;
+out vec4 fragColor;
+void main()
+{
+    fragColor = texture(image, uv) * tint;
+}
+)";
+
+// one program per stereo mode, shared by all batches of the context
+struct Program
+{
+    GLuint name;
+    GLint projection;
+    GLint modelview;
+};
+
+const Program& program(Stereo stereo)
+{
+    static Program programs[3]{};
+    auto& program = programs[static_cast<int>(stereo)];
+    if (program.name == 0)
+    {
+        auto vertex = EyeViews::vertexPrologue(stereo) + kVertexShader;
+        program.name = OpenGlWrap::compileShaders(vertex.c_str(), kFragmentShader);
+        program.projection = glGetUniformLocation(program.name, "projection");
+        program.modelview = glGetUniformLocation(program.name, "modelview");
+        glUseProgram(program.name);
+        glUniform1i(glGetUniformLocation(program.name, "image"), 0);
+        glUseProgram(0);
+    }
+    return program;
+}
+
+}
+
+bool VertexBatch::supported()
+{
+    return GLEW_VERSION_3_3 && GLEW_ARB_vertex_array_object;
+}
+
+GLuint VertexBatch::whiteTexture()
+{
+    static auto texture = []()
+    {
+        const GLubyte white[4] = {255, 255, 255, 255};
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }();
+    return texture;
+}
+
+VertexBatch::VertexBatch()
+    : mRunsDirty{false},
+      mDirtyFrom{std::numeric_limits<size_t>::max()},
+      mDirtyTo{0},
+      mVao{0},
+      mBuffer{0},
+      mCapacity{0}
+{
+}
+
+size_t VertexBatch::quad(const Vertex corners[4], GLuint texture)
+{
+    Primitive primitive{GL_TRIANGLES, texture, mVertices.size(), 6};
+    mVertices.resize(mVertices.size() + 6);
+    mPrimitives.push_back(primitive);
+    mRunsDirty = true;
+    setQuad(mPrimitives.size() - 1, corners, texture);
+    return mPrimitives.size() - 1;
+}
+
+void VertexBatch::setQuad(size_t slot, const Vertex corners[4], GLuint texture)
+{
+    auto& primitive = mPrimitives[slot];
+    if (primitive.texture != texture)
+    {
+        primitive.texture = texture;
+        mRunsDirty = true;
+    }
+    // two triangles, lu ld rd and lu rd ru
+    auto out = mVertices.begin() + primitive.first;
+    for (auto corner : {0, 1, 2, 0, 2, 3})
+    {
+        *out++ = corners[corner];
+    }
+    touch(primitive.first, primitive.first + 6);
+}
+
+void VertexBatch::line(const Vertex& from, const Vertex& to)
+{
+    mPrimitives.push_back(Primitive{GL_LINES, 0, mVertices.size(), 2});
+    mVertices.push_back(from);
+    mVertices.push_back(to);
+    touch(mVertices.size() - 2, mVertices.size());
+    mRunsDirty = true;
+}
+
+void VertexBatch::clear()
+{
+    mVertices.clear();
+    mPrimitives.clear();
+    mRuns.clear();
+    mRunsDirty = false;
+    mDirtyFrom = std::numeric_limits<size_t>::max();
+    mDirtyTo = 0;
+}
+
+void VertexBatch::touch(size_t from, size_t to)
+{
+    mDirtyFrom = std::min(mDirtyFrom, from);
+    mDirtyTo = std::max(mDirtyTo, to);
+}
+
+void VertexBatch::upload()
+{
+    if (mVao == 0)
+    {
+        glGenVertexArrays(1, &mVao);
+        glGenBuffers(1, &mBuffer);
+        glBindVertexArray(mVao);
+        glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, x)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, u)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, r)));
+    }else
+    {
+        glBindVertexArray(mVao);
+        glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    }
+    if (mVertices.size() > mCapacity)
+    {
+        // grows with headroom, never shrinks
+        mCapacity = std::max<size_t>(mVertices.size() * 3 / 2, 256);
+        glBufferData(GL_ARRAY_BUFFER, mCapacity * sizeof(Vertex), nullptr, GL_DYNAMIC_DRAW);
+        mDirtyFrom = 0;
+        mDirtyTo = mVertices.size();
+    }
+    mDirtyTo = std::min(mDirtyTo, mVertices.size());
+    if (mDirtyFrom < mDirtyTo)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, mDirtyFrom * sizeof(Vertex), (mDirtyTo - mDirtyFrom) * sizeof(Vertex),
+                        mVertices.data() + mDirtyFrom);
+    }
+    mDirtyFrom = std::numeric_limits<size_t>::max();
+    mDirtyTo = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (mRunsDirty)
+    {
+        mRuns.clear();
+        for (auto& primitive : mPrimitives)
+        {
+            if (!mRuns.empty() && mRuns.back().mode == primitive.mode && mRuns.back().texture == primitive.texture &&
+                mRuns.back().first + mRuns.back().count == primitive.first)
+            {
+                mRuns.back().count += primitive.count;
+                continue;
+            }
+            mRuns.push_back(primitive);
+        }
+        mRunsDirty = false;
+    }
+}
+
+void VertexBatch::draw(const EyeViews& views, GLfloat lineWidth)
+{
+    if (mPrimitives.empty())
+    {
+        mRuns.clear();
+        return;
+    }
+    auto& shared = program(views.stereo);
+    auto white = whiteTexture();
+    upload();
+    glUseProgram(shared.name);
+    glUniformMatrix4fv(shared.projection, 2, GL_FALSE, views.projection[0]);
+    glUniformMatrix4fv(shared.modelview, 2, GL_FALSE, views.modelview[0]);
+    glLineWidth(lineWidth);
+    glActiveTexture(GL_TEXTURE0);
+    for (auto& run : mRuns)
+    {
+        glBindTexture(GL_TEXTURE_2D, run.texture != 0 ? run.texture : white);
+        glDrawArraysInstanced(run.mode, run.first, run.count, views.copies());
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glLineWidth(1.0f);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/gl.h>
+
+#include "EyeViews.h"
+
+// Geometry kept in a vertex buffer and drawn by one shader program, instead
+// of display lists and glBegin. Quads sit in fixed slots, changing one (new
+// texture, moved) rewrites its six vertices and nothing else goes to the GPU
+// again. Neighbouring primitives sharing a texture are one draw call.
+//
+// Opengl thread only. GL objects go with the context, they are not deleted
+// here.
+class VertexBatch
+{
+public:
+    struct Vertex
+    {
+        GLfloat x, y, z;
+        GLfloat u, v;
+        GLfloat r, g, b, a;
+    };
+
+    // true if driver has vertex array objects and GLSL 3.30
+    static bool supported();
+    // 1x1 white, what texture 0 is drawn with
+    static GLuint whiteTexture();
+
+    VertexBatch();
+
+    // corners lu, ld, rd, ru, texture 0 is plain color, returns slot
+    size_t quad(const Vertex corners[4], GLuint texture);
+    void setQuad(size_t slot, const Vertex corners[4], GLuint texture);
+    // untextured segment
+    void line(const Vertex& from, const Vertex& to);
+    void clear();
+    bool empty() const { return mPrimitives.empty(); }
+
+    void draw(const EyeViews& views, GLfloat lineWidth = 1.0f);
+    // draw calls last draw() made
+    size_t runs() const { return mRuns.size(); }
+
+private:
+    struct Primitive
+    {
+        GLenum mode;
+        GLuint texture;
+        size_t first;
+        size_t count;
+    };
+    void touch(size_t from, size_t to);
+    void upload();
+
+    std::vector<Vertex> mVertices;
+    std::vector<Primitive> mPrimitives;
+    // primitives merged into draw calls, rebuilt when primitives change
+    std::vector<Primitive> mRuns;
+    bool mRunsDirty;
+    // vertices changed since last upload
+    size_t mDirtyFrom;
+    size_t mDirtyTo;
+    GLuint mVao;
+    GLuint mBuffer;
+    size_t mCapacity;
+};
@@ -6,6 +6,7 @@
 
 #include "TypesConf.h"
 #include "Client.h"
+#include "RenderingEngine.h"
 
 #include <IZelement.hh>
 #include "CameraInput/CameraInput.hh"
@@ -210,34 +211,19 @@ public:
                          mDscr.height, 0, alpha ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE,
                          img);
 
-            if (!mList)
-            {
-                mList = glGenLists(1);
-                //TODO: where to delete it within gl ceontextglDeleteLists(*mList, 1);
-            }
-            glNewList(*mList, GL_COMPILE);
-            
+            mBatch.clear();
             if (!mHudMode)
             {
-                glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-                glBindTexture(GL_TEXTURE_2D, *mTexture);// this is needed
-                glEnable(GL_TEXTURE_2D);
-                glPushMatrix();
-                glTranslatef(whereami.x, whereami.y, whereami.z);
-                glBegin(GL_QUADS);
-                glTexCoord2f(0.0, 0.0);
-                glVertex3f(-5.0, -5.0, +5.0);
-                glTexCoord2f(0.0, 1.0);
-                glVertex3f(-5.0, -5.0, -5.0);
-                glTexCoord2f(1.0, 1.0);
-                glVertex3f(+5.0, -5.0, -5.0);
-                glTexCoord2f(1.0, 0.0);
-                glVertex3f(+5.0, -5.0, +5.0);
-                glEnd();
-                glPopMatrix();
-                glDisable(GL_TEXTURE_2D);
+                // floor under us
+                auto x = whereami.x, y = whereami.y, z = whereami.z;
+                const VertexBatch::Vertex corners[4] = {
+                    {x - 5.0f, y - 5.0f, z + 5.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f},
+                    {x - 5.0f, y - 5.0f, z - 5.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f},
+                    {x + 5.0f, y - 5.0f, z - 5.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f},
+                    {x + 5.0f, y - 5.0f, z + 5.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f},
+                };
+                mBatch.quad(corners, *mTexture);
             }
-            glEndList();
 
             delete[] img;
         }
@@ -245,46 +231,16 @@ public:
     
     void generateHud(RenderingEngine* renderingEngine, cl_float x, cl_float y)
     {
-        (void)renderingEngine;
-
         if (!(mTexture && mHudMode))
         {
             return;
         }
-        glClear(GL_DEPTH_BUFFER_BIT);
-
-        glMatrixMode(GL_MODELVIEW);
-        glPushMatrix();
-        glLoadIdentity();
-        glMatrixMode(GL_PROJECTION);
-        glPushMatrix();
-        glLoadIdentity();
-        
-        glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-        glBindTexture(GL_TEXTURE_2D, *mTexture);
-        glEnable(GL_TEXTURE_2D);
-        glBegin(GL_QUADS);
-        
         auto shiftx = +0.3;
         auto shifty = -0.3;
         auto scale = 0.5;
         auto w = 1 * scale;
         auto h = 0.75 * scale;
-        glTexCoord2f(0.0, 0.0);
-        glVertex3f(x - 0 + shiftx, y - 0 + shifty, 0.0);
-        glTexCoord2f(0.0, 1.0);
-        glVertex3f(x - 0 + shiftx, y + h + shifty, 0.0);
-        glTexCoord2f(1.0, 1.0);
-        glVertex3f(x + w + shiftx, y + h + shifty, 0.0);
-        glTexCoord2f(1.0, 0.0);
-        glVertex3f(x + w + shiftx, y - 0 + shifty, 0.0);
-        glEnd();
-        glDisable(GL_TEXTURE_2D);
-    
-        glMatrixMode(GL_PROJECTION);
-        glPopMatrix();
-        glMatrixMode(GL_MODELVIEW);
-        glPopMatrix();
+        renderingEngine->draw_image(x + shiftx, y + shifty, w, h, *mTexture);
     }
 
 private:
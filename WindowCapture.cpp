@@ -0,0 +1,148 @@
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <iostream>
+
+#include "WindowCapture.h"
+#include "TypesConf.h"
+
+WindowCapture::WindowCapture(Display* display, Backend backend)
+    : mBackend{backend},
+      mDisplay{display},
+      mShmInfo{},
+      mShmImage{nullptr},
+      mShmSize{0}
+{
+    if (mBackend == SHM && (display == nullptr || !XShmQueryExtension(display)))
+    {
+        logw_ << "MIT-SHM not available, using XGetImage\n";
+        mBackend = GET_IMAGE;
+    }
+}
+
+WindowCapture::~WindowCapture()
+{
+    destroyShmImage();
+}
+
+const char* WindowCapture::name(Backend backend)
+{
+    return backend == SHM ? "shm" : "getimage";
+}
+
+void WindowCapture::destroyShmImage()
+{
+    if (mShmImage != nullptr)
+    {
+        mShmImage->data = nullptr;  // segment is not owned by image
+        XDestroyImage(mShmImage);
+        mShmImage = nullptr;
+    }
+    if (mShmSize != 0)
+    {
+        XShmDetach(mDisplay, &mShmInfo);
+        shmdt(mShmInfo.shmaddr);
+        mShmSize = 0;
+    }
+}
+
+bool WindowCapture::createShmImage(Display* display, const XWindowAttributes& gwa,
+                                   unsigned int width, unsigned int height)
+{
+    if (mShmImage != nullptr)
+    {
+        mShmImage->data = nullptr;
+        XDestroyImage(mShmImage);
+        mShmImage = nullptr;
+    }
+
+    auto image = XShmCreateImage(display, gwa.visual, gwa.depth, ZPixmap,
+                                 nullptr, &mShmInfo, width, height);
+    if (image == nullptr)
+    {
+        return false;
+    }
+    size_t size = image->bytes_per_line * image->height;
+    if (size > mShmSize)
+    {
+        // grow segment, keep it when window shrinks
+        if (mShmSize != 0)
+        {
+            XShmDetach(display, &mShmInfo);
+            shmdt(mShmInfo.shmaddr);
+            mShmSize = 0;
+        }
+        mShmInfo.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+        if (mShmInfo.shmid < 0)
+        {
+            XDestroyImage(image);
+            return false;
+        }
+        mShmInfo.shmaddr = static_cast<char*>(shmat(mShmInfo.shmid, nullptr, 0));
+        // segment goes away with last detach
+        shmctl(mShmInfo.shmid, IPC_RMID, nullptr);
+        if (mShmInfo.shmaddr == reinterpret_cast<char*>(-1))
+        {
+            XDestroyImage(image);
+            return false;
+        }
+        mShmInfo.readOnly = False;
+        if (!XShmAttach(display, &mShmInfo))
+        {
+            shmdt(mShmInfo.shmaddr);
+            XDestroyImage(image);
+            return false;
+        }
+        XSync(display, False);
+        mShmSize = size;
+    }
+    image->data = mShmInfo.shmaddr;
+    mShmImage = image;
+
+    return true;
+}
+
+XImage* WindowCapture::grab(Display* display, Window window, const XWindowAttributes& gwa,
+                            int x, int y, unsigned int width, unsigned int height)
+{
+    if (mBackend == SHM)
+    {
+        if (mShmImage == nullptr ||
+            mShmImage->width != static_cast<int>(width) ||
+            mShmImage->height != static_cast<int>(height) ||
+            mShmImage->depth != gwa.depth)
+        {
+            if (!createShmImage(display, gwa, width, height))
+            {
+                logw_ << "MIT-SHM image not created, using XGetImage\n";
+                destroyShmImage();
+                mBackend = GET_IMAGE;
+            }
+        }
+        if (mBackend == SHM)
+        {
+            if (XShmGetImage(display, window, mShmImage, x, y, AllPlanes))
+            {
+                return mShmImage;
+            }
+            auto image = XGetImage(display, window, x, y, width, height, AllPlanes, ZPixmap);
+            if (image != nullptr)
+            {
+                // window is fine but shm is not e.g. remote display, do not try again
+                logw_ << "XShmGetImage failed, using XGetImage\n";
+                destroyShmImage();
+                mBackend = GET_IMAGE;
+            }
+            return image;
+        }
+    }
+
+    return XGetImage(display, window, x, y, width, height, AllPlanes, ZPixmap);
+}
+
+void WindowCapture::release(XImage* image)
+{
+    if (image != nullptr && image != mShmImage)
+    {
+        XDestroyImage(image);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+// Grabs window content into an XImage. Uses MIT-SHM when the server offers
+// it, so pixels do not travel through the X socket, and plain XGetImage
+// otherwise.
+class WindowCapture
+{
+public:
+    enum Backend
+    {
+        GET_IMAGE,
+        SHM
+    };
+
+    WindowCapture(Display* display, Backend backend = SHM);
+    ~WindowCapture();
+
+    // image is valid until next grab or release, nullptr on failure
+    XImage* grab(Display* display, Window window, const XWindowAttributes& gwa,
+                 int x, int y, unsigned int width, unsigned int height);
+    void release(XImage* image);
+
+    Backend backend() const { return mBackend; }
+    size_t bufferSize() const { return mShmSize; }
+    static const char* name(Backend backend);
+
+private:
+    bool createShmImage(Display* display, const XWindowAttributes& gwa,
+                        unsigned int width, unsigned int height);
+    void destroyShmImage();
+
+    Backend mBackend;
+    Display* mDisplay;
+    XShmSegmentInfo mShmInfo;
+    XImage* mShmImage;
+    size_t mShmSize;
+};
@@ -0,0 +1,247 @@
+#include <poll.h>
+
+#include <iostream>
+
+#include <X11/extensions/XInput2.h>
+
+#include "WindowStateCache.h"
+#include "TypesConf.h"
+
+WindowStateCache::WindowStateCache(const char* displayName)
+    : mDisplay{nullptr},
+      mRoot{0},
+      mXiOpcode{-1},
+      mFocus{0},
+      mPointerX{-1},
+      mPointerY{-1},
+      mExit{false}
+{
+    mDisplay = XOpenDisplay(displayName);
+    if (mDisplay == nullptr)
+    {
+        throw Error("Unable to open display for window state cache");
+    }
+    mRoot = DefaultRootWindow(mDisplay);
+
+    Window focus{0};
+    int rev;
+    XGetInputFocus(mDisplay, &focus, &rev);
+    mFocus = focus;
+
+    Window root, child;
+    int x, y, wx, wy;
+    unsigned int mask;
+    if (XQueryPointer(mDisplay, mRoot, &root, &child, &x, &y, &wx, &wy, &mask))
+    {
+        mPointerX = x;
+        mPointerY = y;
+    }
+
+    // raw motion is delivered to root whatever window the pointer is over
+    int event, error;
+    if (XQueryExtension(mDisplay, "XInputExtension", &mXiOpcode, &event, &error))
+    {
+        unsigned char bits[XIMaskLen(XI_LASTEVENT)] = {0};
+        XIEventMask mask;
+        mask.deviceid = XIAllMasterDevices;
+        mask.mask_len = sizeof(bits);
+        mask.mask = bits;
+        XISetMask(bits, XI_RawMotion);
+        XISelectEvents(mDisplay, mRoot, &mask, 1);
+    }else
+    {
+        logw_ << "X Input extension not available, pointer will not move\n";
+    }
+    XFlush(mDisplay);
+
+    mThread = std::make_unique<std::thread>(&WindowStateCache::thrFnc, this);
+}
+
+WindowStateCache::~WindowStateCache()
+{
+    mExit = true;
+    mThread->join();
+    XCloseDisplay(mDisplay);
+}
+
+bool WindowStateCache::watch(Window window)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMtx);
+        if (mStates.find(window) != mStates.end())
+        {
+            return true;
+        }
+    }
+
+    State state;
+    XSelectInput(mDisplay, window, StructureNotifyMask | FocusChangeMask);
+    if (!XGetWindowAttributes(mDisplay, window, &state.gwa))
+    {
+        return false;
+    }
+    translate(window, state);
+
+    std::lock_guard<std::mutex> lock(mMtx);
+    mStates[window] = state;
+    return true;
+}
+
+void WindowStateCache::unwatch(Window window)
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    if (mStates.erase(window))
+    {
+        XSelectInput(mDisplay, window, NoEventMask);
+        XFlush(mDisplay);
+    }
+}
+
+bool WindowStateCache::attributes(Window window, XWindowAttributes& gwa) const
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    auto state = mStates.find(window);
+    if (state == mStates.end())
+    {
+        return false;
+    }
+    gwa = state->second.gwa;
+    return true;
+}
+
+bool WindowStateCache::pointer(Window window, int& x, int& y) const
+{
+    std::lock_guard<std::mutex> lock(mMtx);
+    auto state = mStates.find(window);
+    if (state == mStates.end())
+    {
+        return false;
+    }
+    x = mPointerX - state->second.rootX;
+    y = mPointerY - state->second.rootY;
+    return true;
+}
+
+void WindowStateCache::translate(Window window, State& state)
+{
+    Window child;
+    if (!XTranslateCoordinates(mDisplay, window, mRoot, 0, 0,
+                               &state.rootX, &state.rootY, &child))
+    {
+        state.rootX = state.gwa.x;
+        state.rootY = state.gwa.y;
+    }
+}
+
+void WindowStateCache::handleEvent(XEvent& event)
+{
+    switch (event.type)
+    {
+        case ConfigureNotify:
+        {
+            auto& ev = event.xconfigure;
+            State state;
+            {
+                std::lock_guard<std::mutex> lock(mMtx);
+                auto it = mStates.find(ev.window);
+                if (it == mStates.end())
+                {
+                    return;
+                }
+                state = it->second;
+            }
+            state.gwa.x = ev.x;
+            state.gwa.y = ev.y;
+            state.gwa.width = ev.width;
+            state.gwa.height = ev.height;
+            state.gwa.border_width = ev.border_width;
+            if (ev.send_event)
+            {
+                // synthetic one from window manager is in root coordinates
+                state.rootX = ev.x + ev.border_width;
+                state.rootY = ev.y + ev.border_width;
+            }else
+            {
+                // relative to parent, which is a frame under reparenting wm
+                translate(ev.window, state);
+            }
+            std::lock_guard<std::mutex> lock(mMtx);
+            auto it = mStates.find(ev.window);
+            if (it != mStates.end())
+            {
+                it->second = state;
+            }
+            break;
+        }
+        case MapNotify:
+        case UnmapNotify:
+        {
+            std::lock_guard<std::mutex> lock(mMtx);
+            auto it = mStates.find(event.xany.window);
+            if (it != mStates.end())
+            {
+                it->second.gwa.map_state = event.type == MapNotify ? IsViewable : IsUnmapped;
+            }
+            break;
+        }
+        case DestroyNotify:
+        {
+            std::lock_guard<std::mutex> lock(mMtx);
+            mStates.erase(event.xdestroywindow.window);
+            break;
+        }
+        case FocusIn:
+            if (event.xfocus.detail != NotifyPointer)
+            {
+                mFocus = event.xfocus.window;
+            }
+            break;
+        case FocusOut:
+            if (event.xfocus.detail != NotifyPointer &&
+                event.xfocus.detail != NotifyInferior &&
+                mFocus == event.xfocus.window)
+            {
+                mFocus = 0;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void WindowStateCache::thrFnc()
+{
+    for (; !mExit;)
+    {
+        auto moved{false};
+        while (XPending(mDisplay))
+        {
+            XEvent event;
+            XNextEvent(mDisplay, &event);
+            auto cookie = &event.xcookie;
+            if (cookie->type == GenericEvent && cookie->extension == mXiOpcode)
+            {
+                moved = moved || cookie->evtype == XI_RawMotion;
+                continue;
+            }
+            handleEvent(event);
+        }
+
+        // raw events carry no position, ask once per batch of them
+        if (moved)
+        {
+            Window root, child;
+            int x, y, wx, wy;
+            unsigned int mask;
+            if (XQueryPointer(mDisplay, mRoot, &root, &child, &x, &y, &wx, &wy, &mask))
+            {
+                mPointerX = x;
+                mPointerY = y;
+            }
+        }
+
+        pollfd fd{ConnectionNumber(mDisplay), POLLIN, 0};
+        poll(&fd, 1, 100);
+    }
+    logi_ << "Window state cache thread exited\n";
+}
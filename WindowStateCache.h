@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+// Geometry, focus and pointer position of mirrored windows, kept up to date
+// from ConfigureNotify, FocusIn/FocusOut and XInput motion events on its own
+// X connection, so capture does not need a round trip to learn them.
+class WindowStateCache
+{
+public:
+    WindowStateCache(const char* displayName);
+    ~WindowStateCache();
+
+    // start tracking window, one round trip the first time only
+    bool watch(Window window);
+    void unwatch(Window window);
+
+    // false if window is not tracked
+    bool attributes(Window window, XWindowAttributes& gwa) const;
+    // pointer relative to window, false if window is not tracked
+    bool pointer(Window window, int& x, int& y) const;
+
+    Window focus() const { return mFocus; }
+    // focus we just set ourselves, FocusIn will confirm it
+    void setFocus(Window window) { mFocus = window; }
+
+private:
+    struct State
+    {
+        XWindowAttributes gwa;
+        // window origin in root coordinates
+        int rootX, rootY;
+    };
+
+    void thrFnc();
+    void handleEvent(XEvent& event);
+    void translate(Window window, State& state);
+
+    Display* mDisplay;
+    Window mRoot;
+    int mXiOpcode;
+    std::map<Window, State> mStates;
+    mutable std::mutex mMtx;
+    std::atomic<Window> mFocus;
+    std::atomic<int> mPointerX;
+    std::atomic<int> mPointerY;
+    std::atomic<bool> mExit;
+    std::unique_ptr<std::thread> mThread;
+};
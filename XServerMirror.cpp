@@ -4,6 +4,8 @@
 #include "XServerMirror.h"
 #include "RenderingEngine.h"
 #include "LoadPng.h"
+#include "PixelConvert.h"
+#include "BlockCompress.h"
 
 SDL_Event clicknow;
 Mirror::Mirror()
@@ -13,6 +15,10 @@ Mirror::Mirror()
       rot{0, 0, 0, 1},
       width{0},
       height{0},
+      cropX{0},
+      cropY{0},
+      cropWidth{0},
+      cropHeight{0},
       scale{1.0 / 384},
       transparency{0x80},
       haveFocus{false},
@@ -23,23 +29,59 @@ Mirror::Mirror()
       toBeDeleted{false},
       worker(&Mirror::thrFnc, this, this),
       era{0},
+      mBackReady{false},
+      mGlReleased{false},
+      mUploadReleased{false},
+      mPbo{0},
       mTextWidth{0},
-      mTextHeight{0}
+      mTextHeight{0},
+      mShownWidth{0},
+      mShownHeight{0},
+      contentHash{0},
+      changedAt{std::chrono::steady_clock::now()},
+      mCompressedHash{0},
+      compressAfter{0},
+      encoder{nullptr},
+      mSubmittedHash{0},
+      mSubmittedBc1{false},
+      compact{false},
+      imageCompact{false},
+      budget{nullptr},
+      states{nullptr},
+      visible{true},
+      evicted{false}
 {
     std::cout << "new mirror [" << name << "] created\n";
-    mCursor = std::make_shared<XFixesCursorImage>();
-    int width, height;
-    bool alpha;
-    GLubyte *textureImage{nullptr};
-    if (!loadPngImage("cursor16.png", width, height, alpha, &textureImage))
+    mCursor = cursorImage();
+}
+
+std::shared_ptr<XFixesCursorImage> Mirror::cursorImage()
+{
+    // decoded once, shared by all mirrors
+    static auto cursor = []() -> std::shared_ptr<XFixesCursorImage>
     {
-        logw_ << "No cursor";
-        mCursor.reset();
-        return;
-    }
-    mCursor->width = width;
-    mCursor->height = height;
-    mCursor->pixels = (long unsigned int*)textureImage;
+        int width, height;
+        bool alpha;
+        GLubyte *textureImage{nullptr};
+        if (!loadPngImage("cursor16.png", width, height, alpha, &textureImage))
+        {
+            logw_ << "No cursor";
+            return nullptr;
+        }
+        auto cursor = std::make_shared<XFixesCursorImage>();
+        cursor->width = width;
+        cursor->height = height;
+        cursor->pixels = (long unsigned int*)textureImage;
+        return cursor;
+    }();
+    return cursor;
+}
+
+uint64_t Mirror::hashCapture(const uint8_t* pixels, size_t bytes, size_t width, size_t height, bool compact)
+{
+    // never 0, that is what a mirror nobody hashed has submitted
+    return (hashPixels(pixels, bytes) ^ static_cast<uint64_t>(width) ^ static_cast<uint64_t>(height) << 24 ^
+            (compact ? 0x565ull << 48 : 0)) | 1;
 }
 
 Mirror::~Mirror() {
@@ -47,6 +89,14 @@ Mirror::~Mirror() {
     toBeDeleted = true;
     requests.post();
     worker.join();
+    if (budget != nullptr)
+    {
+        budget->remove(this);
+    }
+    if (states != nullptr && window != 0)
+    {
+        states->unwatch(window);
+    }
     std::cout << "mirror [" << name << "] destoroyed\n";
 }
 
@@ -70,93 +120,92 @@ void prn(XImage* p)
               << std::dec;
 }
 
-void Mirror::burnMousePointer(Display* display, Window window, XWindowAttributes gwa)
+void Mirror::burnMousePointer(uint8_t* pixels, int x, int y, int width, int height, bool compact)
 {
-    Window focus_return;
-    int revert_to_return;
-    XGetInputFocus(display, &focus_return, &revert_to_return);
-    if (focus_return == window)
+    int win_x_return, win_y_return;
+    if (states == nullptr ||
+        states->focus() != window ||
+        !states->pointer(window, win_x_return, win_y_return))
+    {
+        return;
+    }
+    win_x_return -= x;
+    win_y_return -= y;
+    if (win_x_return >=0 && win_x_return < width &&
+        win_y_return >=0 && win_y_return < height)
     {
-        Window root_return, child_return;
-        int root_x_return, root_y_return;
-        int win_x_return, win_y_return;
-        unsigned int mask_return;
-        if (XQueryPointer(display,
-                          window,
-                          &root_return,
-                          &child_return,
-                          &root_x_return, &root_y_return,
-                          &win_x_return, &win_y_return,
-                         &mask_return))
+        if (mCursor != nullptr)
         {
-            if (win_x_return >=0 && win_x_return < gwa.width &&
-                win_y_return >=0 && win_y_return < gwa.height)
+            logd_ << "mouse pos " <<  win_x_return << " " << win_y_return << " " << mCursor->width << " " << mCursor->height << "\n";
+            
+            // clip cursor to captured region
+            auto cw = std::min<int>(mCursor->width, width - win_x_return);
+            auto ch = std::min<int>(mCursor->height, height - win_y_return);
+            for (auto ix = 0; ix < cw; ++ix)
             {
-                if (mCursor != nullptr)
+                for(auto iy = 0; iy < ch; ++iy)
                 {
-                    logd_ << "mouse pos " <<  win_x_return << " " << win_y_return << " " << mCursor->width << " " << mCursor->height << "\n";
-                    
-                    for (auto ix = 0; ix < mCursor->width; ++ix)
+                    auto pixel = reinterpret_cast<uint32_t*>(mCursor->pixels) + (mCursor->height - 1 - iy) * mCursor->width + ix;
+                    auto index = (win_y_return + iy) * width + (win_x_return + ix);
+                    if (!(*pixel >> 24))
                     {
-                        for(auto iy = 0; iy < mCursor->height; ++iy)
-                        {
-                            auto pixel = reinterpret_cast<uint32_t*>(mCursor->pixels) + (mCursor->height - iy) * mCursor->width + ix;
-                            auto out = reinterpret_cast<uint32_t*>(mImage.data());
-                            auto op = out + (win_y_return + iy) * gwa.width + (win_x_return + ix);
-                            if (*pixel >> 24)
-                            {
-                                *op = *pixel;
-                            }
-                        }
+                        continue;
                     }
-                    
-                    /*if (clicknow.type == SDL_MOUSEBUTTONDOWN)
+                    if (compact)
                     {
-                        XEvent event;
-                        memset(&event, 0x00, sizeof(event));
-                        event.type = ButtonPress;
-                        event.xbutton.button = Button1;//clicknow.button.button
-                        event.xbutton.same_screen = True;
-                        event.xbutton.root = DefaultRootWindow(display);
-                        event.xbutton.window = window;
-                        event.xbutton.subwindow = 0;
-                        event.xbutton.x_root = root_x_return;
-                        event.xbutton.y_root = root_y_return;
-                        event.xbutton.x = win_x_return;
-                        event.xbutton.y = win_y_return;
-                        event.xbutton.state = 0;
-                        if (XSendEvent(display, PointerWindow, True, ButtonPressMask, &event) == 0)
-                        {
-                            loge_ << "failed to press button\n";
-                        }else{
-                            loge_ << "pressed mouse button";
-                        }
-                    }else if (clicknow.type == SDL_MOUSEBUTTONUP)
+                        packRgb565(reinterpret_cast<const uint8_t*>(pixel), pixels + index * 2, 1);
+                    }else
                     {
-                        XEvent event;
-                        memset(&event, 0x00, sizeof(event));
-                        event.type = ButtonRelease;
-                        event.xbutton.button = Button1;
-                        event.xbutton.same_screen = True;
-                        event.xbutton.root = DefaultRootWindow(display);
-                        event.xbutton.window = window;
-                        event.xbutton.subwindow = 0;
-                        event.xbutton.x_root = root_x_return;
-                        event.xbutton.y_root = root_y_return;
-                        event.xbutton.x = win_x_return;
-                        event.xbutton.y = win_y_return;
-                        event.xbutton.state = Button1Mask;
-                        
-                        if (XSendEvent(display, PointerWindow, True, ButtonReleaseMask, &event) == 0)
-                        {
-                            loge_ << "failed to release button\n";
-                        }else{
-                            loge_ << "released mouse button\n";
-                        }
-                    }*/
-                    clicknow.type = 0;
+                        reinterpret_cast<uint32_t*>(pixels)[index] = *pixel;
+                    }
                 }
             }
+            
+            /*if (clicknow.type == SDL_MOUSEBUTTONDOWN)
+            {
+                XEvent event;
+                memset(&event, 0x00, sizeof(event));
+                event.type = ButtonPress;
+                event.xbutton.button = Button1;//clicknow.button.button
+                event.xbutton.same_screen = True;
+                event.xbutton.root = DefaultRootWindow(display);
+                event.xbutton.window = window;
+                event.xbutton.subwindow = 0;
+                event.xbutton.x_root = root_x_return;
+                event.xbutton.y_root = root_y_return;
+                event.xbutton.x = win_x_return;
+                event.xbutton.y = win_y_return;
+                event.xbutton.state = 0;
+                if (XSendEvent(display, PointerWindow, True, ButtonPressMask, &event) == 0)
+                {
+                    loge_ << "failed to press button\n";
+                }else{
+                    loge_ << "pressed mouse button";
+                }
+            }else if (clicknow.type == SDL_MOUSEBUTTONUP)
+            {
+                XEvent event;
+                memset(&event, 0x00, sizeof(event));
+                event.type = ButtonRelease;
+                event.xbutton.button = Button1;
+                event.xbutton.same_screen = True;
+                event.xbutton.root = DefaultRootWindow(display);
+                event.xbutton.window = window;
+                event.xbutton.subwindow = 0;
+                event.xbutton.x_root = root_x_return;
+                event.xbutton.y_root = root_y_return;
+                event.xbutton.x = win_x_return;
+                event.xbutton.y = win_y_return;
+                event.xbutton.state = Button1Mask;
+                
+                if (XSendEvent(display, PointerWindow, True, ButtonReleaseMask, &event) == 0)
+                {
+                    loge_ << "failed to release button\n";
+                }else{
+                    loge_ << "released mouse button\n";
+                }
+            }*/
+            clicknow.type = 0;
         }
     }
 }
@@ -177,18 +226,39 @@ void* Mirror::thrFnc(Mirror* me)
         mtx.unlock();
         XImage* image{nullptr};
         XWindowAttributes gwa;
+        int rx, ry, rw, rh;
         if (me->display == nullptr || me->window == 0)
         {
             mtx.lock();
             logw_ << "worker serving request failed [" << me->name << "], display " << me->display << " window id " << me->window << "\n";
             mtx.unlock();
         }
-        else
+        else if ((states != nullptr && states->attributes(me->window, gwa)) ||
+                 XGetWindowAttributes(me->display, me->window, &gwa))
         {
-            XGetWindowAttributes(me->display, me->window, &gwa);
-
-            image = XGetImage(me->display, me->window, 0, 0, gwa.width,
-                              gwa.height, AllPlanes, ZPixmap);
+            if (!mCapture)
+            {
+                mCapture = std::make_unique<WindowCapture>(me->display);
+            }
+            // only cropped part of window travels from X server
+            rx = 0;
+            ry = 0;
+            rw = gwa.width;
+            rh = gwa.height;
+            std::unique_lock<std::mutex> crop(cropMtx);
+            if (cropWidth > 0 && cropHeight > 0)
+            {
+                rx = std::min(cropX, gwa.width - 1);
+                ry = std::min(cropY, gwa.height - 1);
+                rw = std::min(cropWidth, gwa.width - rx);
+                rh = std::min(cropHeight, gwa.height - ry);
+            }
+            crop.unlock();
+            if (rw > 0 && rh > 0)
+            {
+                captureTime = std::chrono::steady_clock::now();
+                image = mCapture->grab(me->display, me->window, gwa, rx, ry, rw, rh);
+            }
         }
         /*mtx.lock();
         prn(image);
@@ -200,43 +270,108 @@ void* Mirror::thrFnc(Mirror* me)
         }
         else
         {
-            // let's say we support only 32 bpp
-            if (image->bits_per_pixel == 32)
+            // storage asked for before this capture, it holds for whole of it
+            auto wantCompact = compact;
+            auto outImageSize = image->height * image->width * (wantCompact ? 2u : 4u);
+
+            // straight into mapped upload buffer if opengl thread made one
+            auto ring = std::atomic_load(&mRing);
+            auto slot{-1};
+            uint8_t* out{nullptr};
+            if (ring && ring->slotSize() >= outImageSize && (slot = ring->acquire()) >= 0)
+            {
+                out = ring->data(slot);
+                if (!mImage.empty())
+                {
+                    mImage.clear();
+                    mImage.shrink_to_fit();
+                }
+            }else
             {
-                auto outImageSize = image->height * image->width * 4u;//RGB888 //image->bytes_per_line * image->height;
-               
-                if (mImage.size() < outImageSize)
+                if (mImage.size() != outImageSize)
                 {
                     mImage.resize(outImageSize);
+                    // going background halves it
+                    if (mImage.capacity() > outImageSize * 2)
+                    {
+                        mImage.shrink_to_fit();
+                    }
                 }
-                
+                out = mImage.data();
+            }
+            if (budget != nullptr)
+            {
+                budget->setCpu(this, mImage.capacity() + mCompressed.capacity() + mCapture->bufferSize());
+            }
+
+            if (wantCompact ? convertImage565(image, out) : convertImage(image, out, 128))
+            {
                 me->width = image->width;
                 me->height = image->height;
-
-                for (auto row = 0; row < image->height; ++row)
+                imageCompact = wantCompact;
+                burnMousePointer(out, rx, ry, rw, rh, wantCompact);
+                auto hash = hashCapture(out, outImageSize, image->width, image->height, wantCompact);
+                auto now = std::chrono::steady_clock::now();
+                if (hash != contentHash)
+                {
+                    contentHash = hash;
+                    changedAt = now;
+                }else if (compressAfter.count() > 0 && now - changedAt >= compressAfter &&
+                          mCompressedHash != hash && !mEncoding && encoder != nullptr)
+                {
+                    // once per static period on idle priority encoder, it
+                    // gets a copy as capture goes on into same memory
+                    auto encoding = std::make_shared<Encoding>();
+                    encoding->hash = hash;
+                    mEncoding = encoding;
+                    auto pixels = std::make_shared<std::vector<uint8_t>>(out, out + outImageSize);
+                    auto width = image->width;
+                    auto height = image->height;
+                    encoder->post([encoding, pixels, width, height, wantCompact]()
+                    {
+                        encoding->data.resize(bc1Size(width, height));
+                        if (wantCompact)
+                        {
+                            // encoder takes BGRA
+                            std::vector<uint8_t> bgra(size_t(width) * height * 4);
+                            convertPixels(PIXEL_FORMAT_RGB565, pixels->data(), width * 2, bgra.data(),
+                                          width, height, 128);
+                            compressBc1(bgra.data(), width, height, encoding->data.data());
+                        }else
+                        {
+                            compressBc1(pixels->data(), width, height, encoding->data.data());
+                        }
+                        encoding->done = true;
+                    });
+                }
+                if (mEncoding && mEncoding->done)
                 {
-                    auto rowAdr = row * image->bytes_per_line;
-                    for (auto col = 0; col < image->width; ++col)
+                    // opengl thread reads these while workers wait, only
+                    // here they change; stale if content moved on meanwhile
+                    if (mEncoding->hash == contentHash)
                     {
-                        auto InPixelAdr = rowAdr + (col * image->bits_per_pixel) / 8;
-                        auto InPixelValue = *reinterpret_cast<uint32_t*>(image->data + InPixelAdr);
-                        auto OutPixelAdr = mImage.data() + (row * image->width + col) * 4;
-                        *(OutPixelAdr + 3) = 128;
-                        *(OutPixelAdr + 2) = (InPixelValue & image->red_mask) >> 16;
-                        *(OutPixelAdr + 1) = (InPixelValue & image->green_mask) >> 8;
-                        *(OutPixelAdr + 0) = (InPixelValue & image->blue_mask) >> 0;
+                        mCompressed.swap(mEncoding->data);
+                        mCompressedHash = mEncoding->hash;
                     }
+                    mEncoding.reset();
+                }
+                if (slot >= 0)
+                {
+                    ring->commit(slot, wantCompact);
                 }
-                burnMousePointer(me->display, me->window, gwa);
             }
             else
             {
+                if (slot >= 0)
+                {
+                    ring->cancel(slot);
+                }
                 mtx.lock();
                 logw_ << "worker serving request !32bps [" << me->name << "], display " << me->display << " window id " << me->window << "\n";
                 mtx.unlock();
            
             }
-            XDestroyImage(image);
+            mCapture->release(image);
         }
 
         me->responses.post();
@@ -246,6 +381,12 @@ void* Mirror::thrFnc(Mirror* me)
     return nullptr;
 }
 
+unsigned long XServerMirror::envValue(const char* name, unsigned long defaultValue)
+{
+    auto value = getenv(name);
+    return value != nullptr ? strtoul(value, nullptr, 10) : defaultValue;
+}
+
 std::chrono::system_clock::time_point XServerMirror::findSleepTime()
 {
     if (mMasterList.empty()) {
@@ -272,31 +413,13 @@ std::chrono::system_clock::time_point XServerMirror::findSleepTime()
 }
 
 void XServerMirror::UpdateMasterList(Display* display, Window win) {
-    Atom a = XInternAtom(display, "_NET_CLIENT_LIST", true);
-    Atom actualType;
-    int format;
-    unsigned long numItems, bytesAfter;
-    unsigned char* data = 0;
-    int status =
-        XGetWindowProperty(display, win, a, 0L, (~0L), false, AnyPropertyType,
-                           &actualType, &format, &numItems, &bytesAfter, &data);
-
-    if (status >= Success && numItems)
+    auto clients = clientWindows(display, win);
+    if (!clients.empty())
     {
-        long* array = (long*)data;
-        for (unsigned long k = 0; k < numItems; k++)
+        for (auto& client : clients)
         {
-            // get window Id:
-            Window w = (Window)array[k];
-
-            char* tmp = '\0';
-            status = XFetchName(display, w, &tmp);
-            std::string name = std::string("noname_") + std::to_string(w);
-            if (status >= Success && tmp != nullptr)
-            {
-                name = tmp;
-                XFree(tmp);
-            }
+            Window w = client.first;
+            auto& name = client.second;
             
             logd_ << "window id " << w << " [" << name << "]\n";
 
@@ -328,6 +451,9 @@ void XServerMirror::UpdateMasterList(Display* display, Window win) {
                 mMasterList.back()->display = display;
                 mMasterList.back()->window = w;
                 mMasterList.back()->era = mEra;
+                mMasterList.back()->budget = &mBudget;
+                mMasterList.back()->states = mStates.get();
+                mMasterList.back()->encoder = &mEncoder;
                 logd_ << "new one\n";
             } else
             {  // update existing mirror
@@ -337,9 +463,19 @@ void XServerMirror::UpdateMasterList(Display* display, Window win) {
                 logd_ << "updated\n";
             }
         }
-        XFree(data);
 
-        mMasterList.remove_if([&](auto& mirror) { return mirror->era != mEra; });
+        // closed ones, their GL objects are released on opengl thread
+        for (auto mirror = mMasterList.begin(); mirror != mMasterList.end();)
+        {
+            if ((*mirror)->era != mEra)
+            {
+                mClosed.push_back(*mirror);
+                mirror = mMasterList.erase(mirror);
+            } else
+            {
+                ++mirror;
+            }
+        }
 
         ++mEra;
     }
@@ -374,6 +510,14 @@ boost::property_tree::ptree XServerMirror::serializeList(
         
         jsonMirror.put("updateInterval", mirror->updateInterval.count());
 
+        {
+            std::lock_guard<std::mutex> lock(mirror->cropMtx);
+            jsonMirror.put("cropx", mirror->cropX);
+            jsonMirror.put("cropy", mirror->cropY);
+            jsonMirror.put("cropw", mirror->cropWidth);
+            jsonMirror.put("croph", mirror->cropHeight);
+        }
+
         jsonMirrors.push_back(std::make_pair("", jsonMirror));
     }
     
@@ -382,61 +526,86 @@ boost::property_tree::ptree XServerMirror::serializeList(
     return temp;
 }
 
-std::experimental::optional<Window> XServerMirror::getWindowIdFromName(const std::string& name)
+std::vector<std::pair<Window, std::string>> XServerMirror::clientWindows(Display* display, Window root)
 {
-    Atom a = XInternAtom(mDisplay, "_NET_CLIENT_LIST", true);
+    std::vector<std::pair<Window, std::string>> clients;
+    Atom a = XInternAtom(display, "_NET_CLIENT_LIST", true);
     Atom actualType;
     int format;
     unsigned long numItems, bytesAfter;
     unsigned char* data = 0;
     int status =
-        XGetWindowProperty(mDisplay, mRootWindow, a, 0L, (~0L), false, AnyPropertyType,
+        XGetWindowProperty(display, root, a, 0L, (~0L), false, AnyPropertyType,
                            &actualType, &format, &numItems, &bytesAfter, &data);
+    if (status != Success || data == nullptr)
+    {
+        return clients;
+    }
 
-    if (status >= Success && numItems)
+    // all WM_NAME requests go out before first reply is read, one round trip
+    // for all windows instead of one per window
+    auto connection = XGetXCBConnection(display);
+    std::vector<xcb_get_property_cookie_t> cookies;
+    long* array = (long*)data;
+    for (unsigned long k = 0; k < numItems; k++)
     {
-        long* array = (long*)data;
-        for (unsigned long k = 0; k < numItems; k++)
+        cookies.push_back(xcb_get_property(connection, 0, array[k], XCB_ATOM_WM_NAME,
+                                           XCB_ATOM_STRING, 0, 1024));
+    }
+    for (unsigned long k = 0; k < numItems; k++)
+    {
+        Window w = (Window)array[k];
+        std::string name = std::string("noname_") + std::to_string(w);
+        auto reply = xcb_get_property_reply(connection, cookies[k], nullptr);
+        if (reply != nullptr)
         {
-            // get window Id:
-            Window w = (Window)array[k];
-
-            char* winName = '\0';
-            status = XFetchName(mDisplay, w, &winName);
-            if (status >= Success && winName != nullptr)
+            auto length = xcb_get_property_value_length(reply);
+            if (reply->format == 8 && length > 0)
             {
-                if (winName == nullptr)
-                {
-                    continue;
-                }
-                if (name == winName)
-                {
-                    XFree(winName);
-                    return w;
-                }
-                XFree(winName);
+                name.assign(static_cast<const char*>(xcb_get_property_value(reply)), length);
             }
+            free(reply);
         }
-        XFree(data);
+        clients.emplace_back(w, name);
     }
+    XFree(data);
+
+    return clients;
+}
 
+std::experimental::optional<Window> XServerMirror::getWindowIdFromName(const std::string& name)
+{
+    for (auto& client : clientWindows(mDisplay, mRootWindow))
+    {
+        if (client.second == name)
+        {
+            return client.first;
+        }
+    }
     return std::experimental::optional<Window>();
 }
 
 std::list<std::shared_ptr<Mirror>> XServerMirror::deSerializeList(
-    const boost::property_tree::ptree& tree)
+    const boost::property_tree::ptree& tree, WindowIndex& index)
 {
     std::list<std::shared_ptr<Mirror>> temp;
     for (auto& mirror : tree.get_child("Mirrors"))
     {
-        auto m = std::make_shared<Mirror>();
-        m->name = mirror.second.get<std::string>("name");
-        auto winId = getWindowIdFromName(m->name);
-        if (!winId)
+        auto name = mirror.second.get<std::string>("name");
+        // windows sharing a name are handed out in client list order, equal
+        // keys keep insertion order and find() may return any of them
+        auto winId = index.lower_bound(name);
+        if (winId == index.end() || winId->first != name)
         {
             continue;
         }
-        m->window = *winId;
+        auto m = std::make_shared<Mirror>();
+        m->name = name;
+        m->window = winId->second;
+        index.erase(winId);
+        m->budget = &mBudget;
+        m->states = mStates.get();
+        m->encoder = &mEncoder;
         m->pos.x = mirror.second.get<float>("posx");
         m->pos.y = mirror.second.get<float>("posy");
         m->pos.z = mirror.second.get<float>("posz");
@@ -448,6 +617,11 @@ std::list<std::shared_ptr<Mirror>> XServerMirror::deSerializeList(
         m->scale = mirror.second.get<float>("scale");
         m->transparency = mirror.second.get<uint8_t>("transparency");
         m->updateInterval = std::chrono::milliseconds(mirror.second.get<int>("updateInterval"));
+        // lists saved before cropping existed have no crop
+        m->cropX = mirror.second.get<int>("cropx", 0);
+        m->cropY = mirror.second.get<int>("cropy", 0);
+        m->cropWidth = mirror.second.get<int>("cropw", 0);
+        m->cropHeight = mirror.second.get<int>("croph", 0);
         temp.push_back(m);
     }
     (void)tree;
@@ -455,6 +629,34 @@ std::list<std::shared_ptr<Mirror>> XServerMirror::deSerializeList(
 
 }
 
+void XServerMirror::enforceBudget()
+{
+    for (auto& mirror : mMasterList)
+    {
+        mBudget.touch(mirror.get(), mirror->haveFocus, mirror->visible);
+    }
+    // workers are idle here, cpu buffers can go right away
+    // gpu objects are released by opengl thread on next scene generation
+    for (auto victim : mBudget.selectVictims())
+    {
+        auto mirror = find_if(mMasterList.begin(),
+                              mMasterList.end(),
+                              [&](auto& mirror)
+                              {
+                                  return mirror.get() == victim;
+                              });
+        if (mirror == mMasterList.end())
+        {
+            continue;
+        }
+        logi_ << "evicted [" << (*mirror)->name << "]\n";
+        (*mirror)->evicted = true;
+        (*mirror)->mImage.clear();
+        (*mirror)->mImage.shrink_to_fit();
+        mBudget.setCpu(mirror->get(), 0);
+    }
+}
+
 void XServerMirror::generateHud(RenderingEngine* renderingEngine, cl_float x, cl_float y)
 {
     char text[128];
@@ -462,6 +664,73 @@ void XServerMirror::generateHud(RenderingEngine* renderingEngine, cl_float x, cl
              "Pos: %2.1f %2.1f %2.1f - [%s] %zd %zd",
              t, u, v, mMirrorWithFocus ? mMirrorWithFocus->name.c_str() : "---", (mCounters["cpy"]), (mCounters["updt"]));
     renderingEngine->draw_text(x, y - 0.03, 0, 0.00015, text, true);
+
+    snprintf(text, sizeof(text),
+             "Mem CPU: %zu/%zu MB GPU: %zu/%zu MB evicted: %zu",
+             mBudget.cpuUsed() >> 20, mBudget.cpuCeiling() >> 20,
+             mBudget.gpuUsed() >> 20, mBudget.gpuCeiling() >> 20,
+             mBudget.evictedCount());
+    renderingEngine->draw_text(x, y - 0.06, 0, 0.00015, text, true);
+
+    snprintf(text, sizeof(text), "Capture to display: %zu ms peak %zu ms",
+             mCounters["latency"] / 1000, mCounters["latency_peak"] / 1000);
+    renderingEngine->draw_text(x, y - 0.09, 0, 0.00015, text, true);
+
+    snprintf(text, sizeof(text), "Upload: %zu KB/frame pending %zu pool %zu MB atlas %zu draws %zu",
+             mCounters["upload_budget"] >> 10, mCounters["upload_pending"],
+             mTexturePool.idleBytes() >> 20, mTexturePool.atlasPages(), mInstances.draws());
+    renderingEngine->draw_text(x, y - 0.21, 0, 0.00015, text, true);
+
+    if (mRenderedItems["cropmode"] && mMirrorWithFocus)
+    {
+        std::lock_guard<std::mutex> lock(mMirrorWithFocus->cropMtx);
+        snprintf(text, sizeof(text), "Crop: %d %d %d %d",
+                 mMirrorWithFocus->cropX, mMirrorWithFocus->cropY,
+                 mMirrorWithFocus->cropWidth, mMirrorWithFocus->cropHeight);
+        renderingEngine->draw_text(x, y - 0.18, 0, 0.00015, text, true);
+    }
+}
+
+void XServerMirror::adjustCrop(Mirror* mirror, SDL_Keycode key)
+{
+    const int step{16};
+    std::lock_guard<std::mutex> lock(mirror->cropMtx);
+    if (key == SDLK_r)
+    {
+        mirror->cropX = mirror->cropY = mirror->cropWidth = mirror->cropHeight = 0;
+        return;
+    }
+    if (mirror->cropWidth <= 0 || mirror->cropHeight <= 0)
+    {
+        // start from whole window
+        mirror->cropX = 0;
+        mirror->cropY = 0;
+        mirror->cropWidth = mirror->width;
+        mirror->cropHeight = mirror->height;
+    }
+    // h, j, k, l trim left, bottom, top and right edge, never below one
+    // step; left and top edge stop moving once that is reached
+    auto trimWidth = std::max(std::min(step, mirror->cropWidth - step), 0);
+    auto trimHeight = std::max(std::min(step, mirror->cropHeight - step), 0);
+    switch (key)
+    {
+        case SDLK_h:
+            mirror->cropX += trimWidth;
+            mirror->cropWidth -= trimWidth;
+            break;
+        case SDLK_l:
+            mirror->cropWidth -= trimWidth;
+            break;
+        case SDLK_k:
+            mirror->cropY += trimHeight;
+            mirror->cropHeight -= trimHeight;
+            break;
+        case SDLK_j:
+            mirror->cropHeight -= trimHeight;
+            break;
+    }
+    mirror->cropWidth = std::max(mirror->cropWidth, step);
+    mirror->cropHeight = std::max(mirror->cropHeight, step);
 }
 
 void XServerMirror::handleEvents(SDL_Event& event)
@@ -481,6 +750,19 @@ void XServerMirror::handleEvents(SDL_Event& event)
         case SDLK_f:
             mRenderedItems["dragmode"] = !mRenderedItems["dragmode"];
             break;
+        case SDLK_c:
+            mRenderedItems["cropmode"] = !mRenderedItems["cropmode"];
+            break;
+        case SDLK_h:
+        case SDLK_j:
+        case SDLK_k:
+        case SDLK_l:
+        case SDLK_r:
+            if (mRenderedItems["cropmode"] && mMirrorWithFocus)
+            {
+                adjustCrop(mMirrorWithFocus.get(), event.key.keysym.sym);
+            }
+            break;
         case SDLK_b:
             if (mMirrorWithFocus)
             {
@@ -507,13 +789,20 @@ void XServerMirror::handleEvents(SDL_Event& event)
 
 int handlerX11(Display * d, XErrorEvent * e);
 XServerMirror::XServerMirror(const std::string& masterListName,
-                             const std::string& blackListName)
+                             const std::string& blackListName,
+                             size_t cpuBudget,
+                             size_t gpuBudget)
     : mMasterListName{masterListName},
       mBlackListName{blackListName},
       mEra{1},
       mDisplay{nullptr},
       mRootWindow{0},
-      mRequestSceneGeneration{0}
+      mRequestSceneGeneration{0},
+      mBudget{cpuBudget, gpuBudget},
+      mCycle{0},
+      mFocusDisplay{nullptr},
+      mFocusWakeup{0},
+      mPendingFocus{0}
 {
     XInitThreads();
 
@@ -523,18 +812,67 @@ XServerMirror::XServerMirror(const std::string& masterListName,
 
     try
     {
+        mStates = std::make_unique<WindowStateCache>(":0.0");
+    } catch (const Error& e)
+    {
+        logw_ << e.mMsg << ", capture will query X directly\n";
+    }
+
+    try
+    {
+        WindowIndex index;
+        for (auto& client : clientWindows(mDisplay, mRootWindow))
+        {
+            index.emplace(client.second, client.first);
+        }
+
         boost::property_tree::ptree tree;
         read_json(mMasterListName, tree);
-        mMasterList = deSerializeList(tree);
+        mMasterList = deSerializeList(tree, index);
             
         read_json(mBlackListName, tree);
-        mBlackList = deSerializeList(tree);
+        mBlackList = deSerializeList(tree, index);
     } catch (...)
     {
         logw_ << "Master/Black list not found\n";
     }
        
     mRenderedItems["dragmode"] = false;
+    mRenderedItems["cropmode"] = false;
+}
+
+XServerMirror::XServerMirror(size_t cpuBudget, size_t gpuBudget)
+    : mEra{1},
+      mDisplay{nullptr},
+      mRootWindow{0},
+      mRequestSceneGeneration{0},
+      mBudget{cpuBudget, gpuBudget},
+      mCycle{0},
+      mFocusDisplay{nullptr},
+      mFocusWakeup{0},
+      mPendingFocus{0}
+{
+    mRenderedItems["dragmode"] = false;
+    mRenderedItems["cropmode"] = false;
+}
+
+void XServerMirror::focusFnc(bool* exit)
+{
+    for (; !*exit;)
+    {
+        Window window;
+        while (mFocusRequests.pop(window))
+        {
+            XSetInputFocus(mFocusDisplay, window, RevertToParent, CurrentTime);
+            XMapRaised(mFocusDisplay, window);
+            mStates->setFocus(window);
+        }
+        XFlush(mFocusDisplay);
+        mPendingFocus = 0;
+
+        mFocusWakeup.timed_wait(boost::get_system_time() + boost::posix_time::milliseconds(100));
+    }
+    logi_ << "Focus thread exited\n";
 }
 
 int handlerX11(Display * d, XErrorEvent * e)
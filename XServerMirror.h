@@ -1,17 +1,22 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
+#include <list>
+#include <mutex>
 #include <regex>
 #include <thread>
 
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/Xlib-xcb.h>
 
 #include <boost/interprocess/sync/interprocess_semaphore.hpp>
 #include <boost/property_tree/json_parser.hpp>
@@ -22,10 +27,23 @@
 #include "TypesConf.h"
 #include "geometry.h"
 #include "RenderingEngine.h"
+#include "MemoryBudget.h"
+#include "CaptureFile.h"
+#include "WindowCapture.h"
+#include "WindowStateCache.h"
+#include "UploadRing.h"
+#include "UploadThread.h"
+#include "EncodeThread.h"
+#include "UploadScheduler.h"
+#include "TexturePool.h"
+#include "InstanceBatch.h"
+#include "SpscQueue.h"
 
 #include <GL/glu.h>
 #include <GL/glext.h>
 
+struct UploadFrame;
+
 class Mirror {
 public:
     typedef std::experimental::optional<GLuint> OptionalTexture;
@@ -37,9 +55,16 @@ public:
     cl_float4 pos;
     cl_float4 rot;
     size_t width, height;
+    // captured part of window, zero size means whole window; changed by
+    // input while worker captures, both go through cropMtx
+    int cropX, cropY;
+    int cropWidth, cropHeight;
+    std::mutex cropMtx;
     cl_float scale;
     uint8_t transparency;
-    bool haveFocus;
+    // flags below are set by opengl and master threads and read by the
+    // other one and upload side
+    std::atomic<bool> haveFocus;
     std::chrono::milliseconds updateInterval;
     std::chrono::system_clock::time_point nextUpdate;
     boost::interprocess::interprocess_semaphore
@@ -49,12 +74,71 @@ public:
     std::thread worker;
     uint64_t era;
     std::vector<uint8_t> mImage;
-    OptionalTexture mTexture;
+    // texture drawn and texture uploads go to, swapped by opengl thread once
+    // upload thread has mBackReady set; until then back belongs to uploads
+    TexturePool::Texture mTexture;
+    TexturePool::Texture mBackTexture;
+    std::atomic<bool> mBackReady;
+    // capture time of pixels in back texture
+    std::chrono::steady_clock::time_point mBackCaptureTime;
+    // instance of mirror in scene, none until scene is built with it
+    std::experimental::optional<size_t> mSlot;
+    // what quad is placed around and turned by rot, scene coordinates
+    Vec3f mCenter;
+    // opengl thread, set once releaseGl dropped everything
+    bool mGlReleased;
+    // upload side let go of closed mirror, see retire
+    std::atomic<bool> mUploadReleased;
+    // upload side, frame whose bands are going up
+    std::shared_ptr<UploadFrame> mUploading;
     GLuint mPbo;
-    //size of texture
+    // persistently mapped upload slots, created and replaced by opengl thread
+    std::shared_ptr<UploadRing> mRing;
+    // when pixels now in mImage or newest ring slot were grabbed
+    std::chrono::steady_clock::time_point captureTime;
+    //size of back and front texture content, textures may be larger
     size_t mTextWidth;
     size_t mTextHeight;
+    size_t mShownWidth;
+    size_t mShownHeight;
+    // worker side: hash of last capture, since when it is the same and BC1
+    // encoding of it once it stayed so for compressAfter (zero is never)
+    uint64_t contentHash;
+    std::chrono::steady_clock::time_point changedAt;
+    std::vector<uint8_t> mCompressed;
+    uint64_t mCompressedHash;
+    std::chrono::seconds compressAfter;
+    // BC1 encode running on encoder, worker takes its result on a later
+    // capture; shared so encoder never touches a deleted mirror
+    struct Encoding
+    {
+        std::vector<uint8_t> data;
+        uint64_t hash{0};
+        std::atomic<bool> done{false};
+    };
+    std::shared_ptr<Encoding> mEncoding;
+    EncodeThread* encoder;
+    // opengl thread: content last handed to uploads and if it was BC1,
+    // upload side clears hash when that frame is dropped so it goes again
+    std::atomic<uint64_t> mSubmittedHash;
+    bool mSubmittedBc1;
+    // storage asked for by opengl thread while workers wait, RGB565 if
+    // compact; and what worker put in mImage or ring slot last
+    bool compact;
+    bool imageCompact;
     std::shared_ptr<XFixesCursorImage> mCursor;
+    // cursor burnt into captures, loaded on first use
+    static std::shared_ptr<XFixesCursorImage> cursorImage();
+    // contentHash of captured pixels, uploads are skipped while it stays
+    static uint64_t hashCapture(const uint8_t* pixels, size_t bytes, size_t width, size_t height, bool compact);
+    std::unique_ptr<WindowCapture> mCapture;
+    MemoryBudget* budget;
+    // geometry, focus and pointer from X events, nullptr means ask X
+    WindowStateCache* states;
+    // within field of view, updated by renderer
+    std::atomic<bool> visible;
+    // buffers released by budget manager, not captured until readmitted
+    std::atomic<bool> evicted;
     enum
     {
         ld = 0,
@@ -65,20 +149,63 @@ public:
     Vec3f mConer[4];
 protected:
     void* thrFnc(Mirror* me);
-    void burnMousePointer(Display* display, Window window, XWindowAttributes gwa);
+    // x, y, width, height - captured region of window, pixels hold it
+    // compact - pixels are RGB565
+    void burnMousePointer(uint8_t* pixels, int x, int y, int width, int height, bool compact);
+};
+
+// what an upload job needs from mirror, taken while workers are idle
+struct UploadFrame
+{
+    size_t width{0};
+    size_t height{0};
+    std::chrono::steady_clock::time_point captureTime;
+    // content hash it was submitted with
+    uint64_t hash{0};
+    // copy of mImage when there is no ring slot to take pixels from
+    std::vector<uint8_t> pixels;
+    // BC1 blocks of static window, uploaded in one go instead of pixels
+    std::vector<uint8_t> compressed;
+    // bands frame is cut into go by these
+    size_t rows{0};
+    // pixels are RGB565, BGRA otherwise
+    bool compact{false};
+    size_t pixelBytes() const { return compact ? 2 : 4; }
+    // upload side: ring slot pinned for bands, false once a band failed
+    std::shared_ptr<UploadRing> ring;
+    int slot{-1};
+    bool complete{false};
 };
 
 class XServerMirror : public Client {
    public:
     XServerMirror(const std::string& masterListName,
-                  const std::string& blackListName);
+                  const std::string& blackListName,
+                  size_t cpuBudget,
+                  size_t gpuBudget);
 
     virtual ~XServerMirror()
     {
         std::cout << "XServerMirror going down\n";
         
-        mThread->join(); //external must set exit otherwise we hang here
+        if (mThread && mThread->joinable())
+        {
+            mThread->join(); //external must set exit otherwise we hang here
+        }
+        if (mFocusThread)
+        {
+            mFocusWakeup.post();
+            mFocusThread->join();
+            XCloseDisplay(mFocusDisplay);
+        }
         
+        if (mDisplay == nullptr)
+        {
+            // replay, nothing to save
+            dropMirrors();
+            return;
+        }
+
         try
         {
             write_json(mMasterListName, serializeList(mMasterList));
@@ -90,15 +217,39 @@ class XServerMirror : public Client {
         
         //no workers running
         // destroy all workers do not risk accessing invalid mDisplay
-        mMasterList.clear();
-        mBlackList.clear();
+        dropMirrors();
        
         XCloseDisplay(mDisplay);
     }
 
+    // every reference to mirrors goes before state cache they unwatch from
+    // and before display their captures detach from
+    void dropMirrors()
+    {
+        mMirrorWithFocus.reset();
+        mPendingUploads.clear();
+        mSwapReady.clear();
+        mClosed.clear();
+        mRetiring.clear();
+        mMasterList.clear();
+        mBlackList.clear();
+        mStates.reset();
+    }
+
+    // write every capture to given file for later replay
+    void record(const std::string& fileName)
+    {
+        mRecorder = std::make_unique<CaptureRecorder>(fileName);
+    }
+
     bool run(RenderingEngine* renderingEngine, bool* exit) {
         mThread = std::make_unique<std::thread>(&XServerMirror::thrFnc, this,
                                                 renderingEngine, exit);
+        mFocusDisplay = mStates ? XOpenDisplay(":0.0") : nullptr;
+        if (mFocusDisplay != nullptr)
+        {
+            mFocusThread = std::make_unique<std::thread>(&XServerMirror::focusFnc, this, exit);
+        }
 
         return true;
     }
@@ -112,6 +263,9 @@ class XServerMirror : public Client {
 
     void UpdateMasterList(Display* display, Window win);
 
+    // owns all X traffic for focus, fed by render thread through mFocusRequests
+    void focusFnc(bool* exit);
+
     void* thrFnc(RenderingEngine* renderingEngine, bool* exit) {
         (void)renderingEngine;
 
@@ -122,10 +276,25 @@ class XServerMirror : public Client {
             std::this_thread::sleep_until(findSleepTime());
 
             UpdateMasterList(mDisplay, mRootWindow);
+            enforceBudget();
             
             std::list<std::shared_ptr<Mirror>> waitList;
             for (auto& mirror : mMasterList) {
                 if (mirror->nextUpdate < std::chrono::system_clock::now()) {
+                    if (mirror->evicted &&
+                        !((mirror->haveFocus || mirror->visible) &&
+                          mBudget.readmit(mirror.get(),
+                                          mirror->width * mirror->height * 4,
+                                          mirror->width * mirror->height * 8)))
+                    {
+                        mirror->nextUpdate = std::chrono::system_clock::now() + mirror->updateInterval;
+                        continue;
+                    }
+                    mirror->evicted = false;
+                    if (mStates && mirror->window != 0)
+                    {
+                        mStates->watch(mirror->window);
+                    }
                     mirror->requests.post();
                     waitList.push_back(mirror);
                     mirror->nextUpdate = std::chrono::system_clock::now() +
@@ -141,8 +310,14 @@ class XServerMirror : public Client {
             for(auto& mirror : waitList)
             {
                 mirror->responses.wait();
+                if (mRecorder && mirror->width * mirror->height * 4 <= mirror->mImage.size())
+                {
+                    mRecorder->write(mirror->window, mCycle, mirror->width,
+                                     mirror->height, mirror->mImage.data());
+                }
                 requestSceneGeneration(true, mirror.get());
             }
+            ++mCycle;
             requestSceneGeneration(false, nullptr);
             if (!mRequestSceneGeneration.timed_wait(boost::get_system_time() + boost::posix_time::milliseconds(500)))
             {
@@ -184,85 +359,626 @@ class XServerMirror : public Client {
         return t > kEpsilon;
     }
     
-    void Upload(Mirror* mirror)
+    void enforceBudget();
+
+    // drop GL objects of evicted mirror, must be called from opengl thread
+    void releaseGl(Mirror* mirror, RenderingEngine* renderingEngine)
     {
-        uint32_t* img = (uint32_t*)(mirror->mImage.data());
-        if (mirror->mTexture)
+        mTexturePool.release(mirror->mTexture);
+        updateInstance(mirror);
+        mScheduler.remove(mirror);
+        // back one is freed by upload side unless it waits for a swap
+        auto shared = findMirror(mirror);
+        runUpload(renderingEngine, [this, shared]()
         {
-            glBindTexture(GL_TEXTURE_2D, *mirror->mTexture);
-            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mirror->mPbo);
-            if (mirror->width != mirror->mTextWidth || mirror->height != mirror->mTextHeight)
+            if (shared->mUploading)
             {
-                glBindTexture(GL_TEXTURE_2D, 0);
-                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); //TODO: needed ? ok ?
-                glDeleteTextures(1, &*mirror->mTexture);
-                glDeleteBuffers(1, &mirror->mPbo);
-                mirror->mTexture = {};
+                releaseSlot(*shared->mUploading);
+                shared->mUploading.reset();
             }
+            if (!shared->mBackReady)
+            {
+                releaseBack(shared.get());
+                // ring itself goes once workers let go of it, see mRings
+                std::atomic_store(&shared->mRing, std::shared_ptr<UploadRing>());
+            }
+        });
+        mBudget.setGpu(mirror, 0);
+        mirror->mGlReleased = true;
+        // uploads start over once readmitted
+        mirror->mSubmittedHash = 0;
+    }
+
+    // closed window, opengl thread: its textures and upload slots go back
+    // before the mirror itself, last reference is dropped here too
+    void retire(const std::shared_ptr<Mirror>& mirror, RenderingEngine* renderingEngine)
+    {
+        // scene is rebuilt without it, slot is someone else's now
+        mirror->mSlot = std::experimental::nullopt;
+        // uploads drop its frames, swap frees back texture if one waits
+        mirror->evicted = true;
+        mPendingUploads.erase(mirror.get());
+        mScheduler.remove(mirror.get());
+        if (mMirrorWithFocus == mirror)
+        {
+            mMirrorWithFocus.reset();
         }
+        mTexturePool.release(mirror->mTexture);
+        mBudget.setGpu(mirror.get(), 0);
+        mirror->mGlReleased = true;
+        // no reference goes with the job, ~Mirror stays off upload thread
+        auto raw = mirror.get();
+        runUpload(renderingEngine, [this, raw]()
+        {
+            if (raw->mUploading)
+            {
+                releaseSlot(*raw->mUploading);
+                raw->mUploading.reset();
+            }
+            if (!raw->mBackReady)
+            {
+                releaseBack(raw);
+            }
+            std::atomic_store(&raw->mRing, std::shared_ptr<UploadRing>());
+            raw->mUploadReleased = true;
+        });
+        mRetiring.push_back(mirror);
+    }
 
-        if (!mirror->mTexture)
+    // upload side
+    void releaseBack(Mirror* mirror)
+    {
+        mTexturePool.release(mirror->mBackTexture);
+        if (mirror->mPbo != 0)
         {
-            GLuint texture;
-            glGenTextures(1, &texture);
-            mirror->mTexture = texture;
-            glBindTexture(GL_TEXTURE_2D, *mirror->mTexture);
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, mirror->width, mirror->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, img);
-            glBindTexture(GL_TEXTURE_2D, 0);
-            mirror->mTextWidth = mirror->width;
-            mirror->mTextHeight = mirror->height;
+            glDeleteBuffers(1, &mirror->mPbo);
+            mirror->mPbo = 0;
+        }
+    }
+
+    // back texture able to hold frame, false if there is none
+    // create - first band of frame, texture may be swapped for one that fits
+    bool prepareBack(Mirror* mirror, const UploadFrame& frame, bool create)
+    {
+        if (!create)
+        {
+            return frame.width == mirror->mTextWidth && frame.height == mirror->mTextHeight &&
+                   TexturePool::fits(mirror->mBackTexture, frame.width, frame.height, frame.compact);
+        }
+        if (!TexturePool::fits(mirror->mBackTexture, frame.width, frame.height, frame.compact))
+        {
+            // resized out of its size class, someone else may still fit
+            // atlas cell next to front when possible, scene keeps one bind
+            auto near = mirror->mBackTexture.name;
+            mTexturePool.release(mirror->mBackTexture);
+            mirror->mBackTexture = mTexturePool.acquire(frame.width, frame.height, near, frame.compact);
+        }
+        mirror->mTextWidth = frame.width;
+        mirror->mTextHeight = frame.height;
+        return static_cast<bool>(mirror->mBackTexture);
+    }
+
+    // texture update from persistently mapped ring, nothing here waits for
+    // the GPU or makes the driver reallocate
+    // returns false if ring is not usable, true otherwise, updated tells if
+    // rows of back texture got new pixels
+    bool UploadFromRing(Mirror* mirror, UploadFrame& frame, size_t row, size_t rows, bool& updated)
+    {
+        size_t bytes = frame.width * frame.height * frame.pixelBytes();
+        if (bytes == 0)
+        {
+            return true;
+        }
+        if (row == 0)
+        {
+            auto ring = std::atomic_load(&mirror->mRing);
+            if (!ring || ring->slotSize() < bytes)
+            {
+                try
+                {
+                    // slots grow with size class too, resizing within it keeps ring
+                    ring = std::make_shared<UploadRing>(TexturePool::sizeClass(frame.width) *
+                                                        TexturePool::sizeClass(frame.height) * frame.pixelBytes());
+                } catch (const Error& e)
+                {
+                    loge_ << e.mMsg << ", back to plain PBO\n";
+                    mRingFailed = true;
+                    return false;
+                }
+                mRings.push_back(ring);
+                std::atomic_store(&mirror->mRing, ring);
+            }
+            ring->retire();
+            auto fresh{-1};
+            if (frame.pixels.size() >= bytes && (fresh = ring->acquire()) >= 0)
+            {
+                // captured before ring existed or was big enough, or fed by
+                // replay; newer than anything ring holds
+                ::memcpy(ring->data(fresh), frame.pixels.data(), bytes);
+                ring->commit(fresh, frame.compact);
+            }
+            auto slot = ring->latest();
+            if (slot < 0)
+            {
+                // nothing to show, back keeps what it has
+                return true;
+            }
+            // slot may be newer than frame, storage goes by what it holds
+            frame.compact = ring->tag(slot) != 0;
+            prepareBack(mirror, frame, true);
+            // front + back texture + ring
+            mBudget.setGpu(mirror, mirror->mBackTexture.bytes() * 2 + ring->bytes());
+            // later bands read same slot
+            ring->pin(slot);
+            frame.ring = ring;
+            frame.slot = slot;
+        }
+        if (!frame.ring || !prepareBack(mirror, frame, false))
+        {
+            return true;
+        }
+        glBindTexture(GL_TEXTURE_2D, mirror->mBackTexture.name);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame.ring->buffer());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        auto& back = mirror->mBackTexture;
+        auto offset = static_cast<const uint8_t*>(frame.ring->offset(frame.slot)) + row * frame.width * frame.pixelBytes();
+        glTexSubImage2D(GL_TEXTURE_2D, 0, back.x, back.y + row, frame.width, rows, back.format(), back.type(), offset);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if (row + rows == frame.height)
+        {
+            releaseSlot(frame);
+        }
+        updated = true;
+        return true;
+    }
 
+    // ring slot of frame may be reused once GPU is done with it
+    void releaseSlot(UploadFrame& frame)
+    {
+        if (frame.ring)
+        {
+            frame.ring->fence(frame.slot);
+            frame.ring.reset();
+        }
+    }
+
+    // fills rows of back texture of mirror, true if they got new pixels
+    bool Upload(Mirror* mirror, UploadFrame& frame, size_t row, size_t rows)
+    {
+        if (!frame.compressed.empty())
+        {
+            // replaces whatever back was, pool deletes BC1 ones on release
+            mTexturePool.release(mirror->mBackTexture);
+            mirror->mBackTexture = TexturePool::createBc1(frame.compressed.data(), frame.compressed.size(),
+                                                          frame.width, frame.height);
+            mirror->mTextWidth = frame.width;
+            mirror->mTextHeight = frame.height;
+            mBudget.setGpu(mirror, mirror->mBackTexture.bytes() * 2);
+            return true;
+        }
+        auto updated{false};
+        if (useRing() && UploadFromRing(mirror, frame, row, rows, updated))
+        {
+            return updated;
+        }
+        if (frame.pixels.size() < frame.width * frame.height * frame.pixelBytes())
+        {
+            return false;
+        }
+        if (!prepareBack(mirror, frame, row == 0))
+        {
+            return false;
+        }
+        if (mirror->mPbo == 0)
+        {
+            // orphaned on every upload, it outlives resizes
             glGenBuffers(1, &mirror->mPbo);
-            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mirror->mPbo);
-            glBufferData(GL_PIXEL_UNPACK_BUFFER, mirror->width * mirror->height * 4, 0, GL_DYNAMIC_DRAW);
-            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        if (row == 0)
+        {
+            // front + back texture + pbo
+            mBudget.setGpu(mirror, mirror->mBackTexture.bytes() * 2 + frame.width * frame.height * frame.pixelBytes());
+        }
+
+        // fill, unmap, then update texture from it, texture shows this
+        // capture and not the one before
+        auto bytes = frame.width * rows * frame.pixelBytes();
+        glBindTexture(GL_TEXTURE_2D, mirror->mBackTexture.name);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mirror->mPbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, 0, GL_DYNAMIC_DRAW);
+        GLubyte* ptr = (GLubyte*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if (ptr)
+        {
+            ::memcpy(ptr, frame.pixels.data() + row * frame.width * frame.pixelBytes(), bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); // release pointer to mapping buffer
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            auto& back = mirror->mBackTexture;
+            glTexSubImage2D(GL_TEXTURE_2D, 0, back.x, back.y + row, frame.width, rows, back.format(), back.type(), 0);
         }else
         {
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mirror->width, mirror->height, GL_BGRA, GL_UNSIGNED_BYTE, 0);
-            glBufferData(GL_PIXEL_UNPACK_BUFFER, mirror->width * mirror->height * 4, 0, GL_DYNAMIC_DRAW);
-            GLubyte* ptr = (GLubyte*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
-            if (ptr)
+            loge_ << "failed to map PBO\n";
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return ptr != nullptr;
+    }
+
+    // recording reads frames back from mImage, keep workers writing there
+    bool useRing() const
+    {
+        return !mRecorder && !mRingFailed && UploadRing::supported();
+    }
+
+    // upload job for one band: fill rows of back texture, after last band
+    // wait on its fence here and not on render thread, then hand it over
+    // for swapping
+    void uploadBack(const std::shared_ptr<Mirror>& mirror, const std::shared_ptr<UploadFrame>& frame,
+                    size_t row, size_t rows, bool threaded)
+    {
+        // rings of resized, evicted or deleted mirrors
+        mRings.remove_if([](auto& ring) { return ring.use_count() == 1; });
+        if (row == 0)
+        {
+            // frame replaced before all its bands went up
+            if (mirror->mUploading && mirror->mUploading != frame)
             {
-                
-                ::memcpy(ptr, img, mirror->width * mirror->height * 4);
-                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); // release pointer to mapping buffer
-            }else
+                releaseSlot(*mirror->mUploading);
+                dropped(mirror.get(), *mirror->mUploading);
+            }
+            mirror->mUploading = frame;
+            frame->complete = true;
+        }
+        if (mirror->mUploading != frame || !frame->complete)
+        {
+            return;
+        }
+        if (mirror->mBackReady || mirror->evicted)
+        {
+            // previous one not swapped yet, a newer capture follows anyway
+            frame->complete = false;
+            releaseSlot(*frame);
+            dropped(mirror.get(), *frame);
+            return;
+        }
+        timeUpload(frame->width * rows * frame->pixelBytes(), [&]()
+        {
+            frame->complete = Upload(mirror.get(), *frame, row, rows);
+        });
+        if (!frame->complete)
+        {
+            releaseSlot(*frame);
+            dropped(mirror.get(), *frame);
+        }
+        if (!frame->complete || row + rows != frame->rows)
+        {
+            return;
+        }
+        mirror->mUploading.reset();
+        // no damage tracking, window part of texture is what changed
+        mTexturePool.updateMipmaps(mirror->mBackTexture, frame->width, frame->height);
+        if (threaded)
+        {
+            auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100'000'000);
+            glDeleteSync(fence);
+        }
+        mirror->mBackCaptureTime = frame->captureTime;
+        mirror->mBackReady = true;
+        ++mUploaded;
+        {
+            std::lock_guard<std::mutex> lock(mSwapMtx);
+            mSwapReady.push_back(mirror);
+        }
+        if (threaded)
+        {
+            requestSceneGeneration(kTexturesReady, nullptr);
+        }
+    }
+
+    // upload side, frame will not reach the screen: its content is
+    // submitted again unless something newer already was
+    void dropped(Mirror* mirror, const UploadFrame& frame)
+    {
+        auto hash = frame.hash;
+        mirror->mSubmittedHash.compare_exchange_strong(hash, 0);
+    }
+
+    // upload side, GPU time of upload goes to scheduler once known
+    void timeUpload(size_t bytes, std::function<void()> upload)
+    {
+        if (!UploadScheduler::timerSupported())
+        {
+            upload();
+            return;
+        }
+        GLuint query;
+        glGenQueries(1, &query);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        upload();
+        glEndQuery(GL_TIME_ELAPSED);
+        mTimerQueries.emplace_back(query, bytes);
+
+        // results come a frame or so later, never wait for them
+        while (!mTimerQueries.empty())
+        {
+            GLint available{0};
+            glGetQueryObjectiv(mTimerQueries.front().first, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                break;
+            }
+            GLuint64 ns{0};
+            glGetQueryObjectui64v(mTimerQueries.front().first, GL_QUERY_RESULT, &ns);
+            mScheduler.measured(mTimerQueries.front().second, ns);
+            glDeleteQueries(1, &mTimerQueries.front().first);
+            mTimerQueries.pop_front();
+        }
+    }
+
+    // run on upload thread if there is one, right here otherwise; no
+    // rendering engine (capture_bench) is no upload thread
+    void runUpload(RenderingEngine* renderingEngine, std::function<void()> job)
+    {
+        auto uploader = renderingEngine != nullptr ? renderingEngine->uploader() : nullptr;
+        if (uploader != nullptr)
+        {
+            uploader->post(job);
+        }else
+        {
+            job();
+        }
+    }
+
+    // opengl thread, only texture handles change here
+    void swapTextures()
+    {
+        std::list<std::shared_ptr<Mirror>> ready;
+        {
+            std::lock_guard<std::mutex> lock(mSwapMtx);
+            ready.swap(mSwapReady);
+        }
+        for (auto& mirror : ready)
+        {
+            if (!mirror->mBackReady)
+            {
+                continue;
+            }
+            if (mirror->evicted)
+            {
+                releaseBack(mirror.get());
+                mirror->mBackReady = false;
+                continue;
+            }
+            std::swap(mirror->mTexture, mirror->mBackTexture);
+            // back keeps size of what it held, wrong size is recreated on next upload
+            std::swap(mirror->mTextWidth, mirror->mShownWidth);
+            std::swap(mirror->mTextHeight, mirror->mShownHeight);
+            mirror->mBackReady = false;
+            updateInstance(mirror.get());
+            mSwapped.push_back(mirror->mBackCaptureTime);
+        }
+    }
+
+    // opengl thread, frame with last swapped textures went out with buffer
+    // swap before this frame started: capture to display
+    void countLatency()
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (auto captureTime : mSwapped)
+        {
+            uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now - captureTime).count();
+            mCounters["latency"] = (mCounters["latency"] * 7 + us) / 8;
+            mCounters["latency_peak"] = std::max(us, mCounters["latency_peak"] * 63 / 64);
+        }
+        mSwapped.clear();
+    }
+
+    // opengl thread, once per frame: hand this frame's share of uploads to
+    // upload thread
+    virtual void frameStart(cl_float4& whereami, cl_float4& lookat, RenderingEngine* renderingEngine)
+    {
+        countLatency();
+        for (auto pending = mPendingUploads.begin(); pending != mPendingUploads.end();)
+        {
+            auto& mirror = pending->second.first;
+            if (mirror->evicted)
+            {
+                mScheduler.remove(mirror.get());
+                pending = mPendingUploads.erase(pending);
+                continue;
+            }
+            // corners are in scene, direction counts from where we are
+            auto center = (Vec3f(mirror->mConer[Mirror::lu]) + Vec3f(mirror->mConer[Mirror::rd])) * 0.5f -
+                          Vec3f(whereami);
+            auto gaze = center.normalize().dotProduct(Vec3f(lookat));
+            mScheduler.touch(mirror.get(), mirror->haveFocus, gaze, mirror->mBackReady);
+            ++pending;
+        }
+
+        auto threaded = renderingEngine != nullptr && renderingEngine->uploader() != nullptr;
+        for (auto& band : mScheduler.schedule())
+        {
+            auto mirror = static_cast<Mirror*>(const_cast<void*>(band.key));
+            auto pending = mPendingUploads.find(mirror);
+            if (pending == mPendingUploads.end())
             {
-                loge_ << "failed to map PBO\n";
+                continue;
+            }
+            auto shared = pending->second.first;
+            auto frame = pending->second.second;
+            runUpload(renderingEngine, [this, shared, frame, band, threaded]()
+            {
+                uploadBack(shared, frame, band.row, band.rows, threaded);
+            });
+            if (band.last)
+            {
+                mPendingUploads.erase(pending);
             }
-            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
         }
+        if (!threaded)
+        {
+            swapTextures();
+        }
+        mCounters["upload_budget"] = mScheduler.budget();
+        mCounters["upload_pending"] = mScheduler.pending();
+    }
+
+    // front texture part or grey placeholder into instance of mirror in
+    // scene, that instance is all that goes to GPU
+    void updateInstance(Mirror* mirror)
+    {
+        if (!mirror->mSlot)
+        {
+            return;
+        }
+        mInstances.set(*mirror->mSlot, mirrorInstance(mirror), mirror->mTexture.name);
+    }
+
+    InstanceBatch::Instance mirrorInstance(const Mirror* mirror)
+    {
+        InstanceBatch::Instance instance{};
+        auto& texture = mirror->mTexture;
+        // placeholder, still can be looked at to get focus back
+        cl_float4 color{0.3f, 0.3f, 0.3f, 0.5f};
+        GLfloat uv[4] = {0, 0, 1, 1};
+        if (texture)
+        {
+            // window sits in top left part of its pooled texture or atlas cell
+            uv[0] = static_cast<GLfloat>(texture.x) / texture.textureWidth;
+            uv[1] = static_cast<GLfloat>(texture.y) / texture.textureHeight;
+            uv[2] = static_cast<GLfloat>(texture.x + mirror->mShownWidth) / texture.textureWidth;
+            uv[3] = static_cast<GLfloat>(texture.y + mirror->mShownHeight) / texture.textureHeight;
+            // BC1 and RGB565 have no alpha, captures carry 128
+            auto opaque = texture.compressed || texture.compact;
+            color = {1.0f, 1.0f, 1.0f, opaque ? 0.5f : 1.0f};
+        }
+        std::copy(uv, uv + 4, instance.uv);
+        instance.color[0] = color.x;
+        instance.color[1] = color.y;
+        instance.color[2] = color.z;
+        instance.color[3] = color.w;
+        instance.position[0] = mirror->mCenter.x;
+        instance.position[1] = mirror->mCenter.y;
+        instance.position[2] = mirror->mCenter.z;
+        instance.halfWidth = mirror->width / 2 * mirror->scale;
+        instance.halfHeight = mirror->height / 2 * mirror->scale;
+        instance.rotation[0] = mirror->rot.x;
+        instance.rotation[1] = mirror->rot.y;
+        instance.rotation[2] = mirror->rot.z;
+        instance.rotation[3] = mirror->rot.w;
+        return instance;
+    }
+
+    // all mirrors in as few instanced draws as textures allow
+    virtual void draw(const EyeViews& views)
+    {
+        mInstances.draw(views);
+    }
+
+    std::shared_ptr<Mirror> findMirror(Mirror* mirror)
+    {
+        for (auto& m : mMasterList)
+        {
+            if (m.get() == mirror)
+            {
+                return m;
+            }
+        }
+        return nullptr;
     }
     
     virtual void generateScene(const SDL_Event& event, cl_float4& whereami, cl_float4& lookat, RenderingEngine* renderingEngine)
     {
         Mirror* mirror = static_cast<Mirror*>(event.user.data2);
-        bool upload = static_cast<bool>(event.user.code);
+        bool upload = event.user.code == kUpload;
         
-        if (upload && mirror != nullptr && mirror->mImage.size() > 0)
+        if (event.user.code == kTexturesReady)
         {
-            Upload(mirror);
+            swapTextures();
+            return;
+        }
+        if (upload && mirror != nullptr && !mirror->evicted &&
+            (mirror->mImage.size() > 0 || std::atomic_load(&mirror->mRing)))
+        {
+            // master thread waits for us, list is stable
+            auto shared = findMirror(mirror);
+            auto compressed = mirror->mCompressedHash != 0 && mirror->mCompressedHash == mirror->contentHash;
+            mirror->compressAfter = TexturePool::bc1Supported() ? mCompressAfter : std::chrono::seconds(0);
+            mirror->compact = compactFor(mirror);
+            // 0 is content nobody hashed, always new
+            if (mirror->contentHash != 0 && mirror->contentHash == mirror->mSubmittedHash &&
+                (!compressed || mirror->mSubmittedBc1))
+            {
+                // nothing new, static windows stop costing uploads here;
+                // drop repeats so worker keeps finding free slots
+                if (auto ring = std::atomic_load(&mirror->mRing))
+                {
+                    ring->latest();
+                }
+                return;
+            }
+            if (shared)
+            {
+                mirror->mGlReleased = false;
+                mirror->mSubmittedHash = mirror->contentHash;
+                mirror->mSubmittedBc1 = compressed;
+                // workers capture again once master moves on, take what
+                // upload needs while they wait
+                auto frame = std::make_shared<UploadFrame>();
+                frame->width = mirror->width;
+                frame->height = mirror->height;
+                frame->captureTime = mirror->captureTime;
+                frame->hash = mirror->contentHash;
+                frame->compact = mirror->imageCompact;
+                if (compressed)
+                {
+                    frame->compressed = mirror->mCompressed;
+                    frame->rows = 1;
+                }else
+                {
+                    // worker falls back to mImage when ring is too small for
+                    // resized window, it is emptied whenever ring is used
+                    if (!useRing() || !std::atomic_load(&mirror->mRing) || !mirror->mImage.empty())
+                    {
+                        frame->pixels = mirror->mImage;
+                    }
+                    frame->rows = frame->height;
+                }
+                // goes up in frameStart, newest one wins
+                mPendingUploads[mirror] = std::make_pair(shared, frame);
+                mScheduler.submit(mirror, compressed ? frame->compressed.size() : frame->width * frame->pixelBytes(),
+                                  frame->rows);
+            }
             return;
         }else
         {
             logw_ << "Update Failed \n";
         }
         
-        if (!mList)
+        for (auto& mirror : mClosed)
         {
-            mList = glGenLists(1);
-            // TODO: where to delete it within gl
-            // ceontextglDeleteLists(*mList, 1);
+            retire(mirror, renderingEngine);
+        }
+        mClosed.clear();
+        // back texture waiting for swap is freed by swapTextures
+        mRetiring.remove_if([](auto& mirror) { return mirror->mUploadReleased && !mirror->mBackReady; });
+        for (auto& mirror : mMasterList)
+        {
+            if (mirror->evicted && !mirror->mGlReleased)
+            {
+                releaseGl(mirror.get(), renderingEngine);
+            }
         }
+        // windows sharing an atlas page are neighbours, one unit of draw
+        std::vector<std::shared_ptr<Mirror>> drawOrder(mMasterList.begin(), mMasterList.end());
+        std::stable_sort(drawOrder.begin(), drawOrder.end(), [](auto& a, auto& b)
+        {
+            return a->mTexture.name < b->mTexture.name;
+        });
 
-        glNewList(*mList, GL_COMPILE);
-        glEnable(GL_TEXTURE_2D);
-        for(auto& mirror : mMasterList)
+        mInstances.clear();
+        for(auto& mirror : drawOrder)
         {
             if (mirror->pos.w == 0)
             {
@@ -274,37 +990,36 @@ class XServerMirror : public Client {
             logd_ << "Rendering " << mirror->name << " " << mirror->window << " " << mirror->mConer[Mirror::lu].x << " " << mirror->mConer[Mirror::lu].y << " " << mirror->mConer[Mirror::lu].z << "\n";
             logd_ << "Rendering " << mirror->name << " " << mirror->window << " " << mirror->width << " " << mirror->height << "\n";
         
-            glBindTexture(GL_TEXTURE_2D, *mirror->mTexture);
-            glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-            //glPushMatrix();
-            glBegin(GL_QUADS);
-            glTexCoord2f(0.0, 0.0);
             auto scaledHalfWidth = mirror->width / 2 * mirror->scale;
             auto scaledHalfHeight = mirror->height / 2 * mirror->scale;
             mirror->mConer[Mirror::lu] = renderingEngine->rotate_vertex_position({-scaledHalfWidth, +scaledHalfHeight, -5.0f}, mirror->rot);
             mirror->mConer[Mirror::lu] += Vec3f(whereami);
             mirror->mConer[Mirror::lu] += Vec3f(mirror->pos);
-            glVertex3f(mirror->mConer[Mirror::lu].x, mirror->mConer[Mirror::lu].y, mirror->mConer[Mirror::lu].z);
-            glTexCoord2f(0.0, 1.0);
             mirror->mConer[Mirror::ld] = renderingEngine->rotate_vertex_position({-scaledHalfWidth, -scaledHalfHeight, -5.0f}, mirror->rot);
             mirror->mConer[Mirror::ld] += Vec3f(whereami);
             mirror->mConer[Mirror::ld] += Vec3f(mirror->pos);
-            glVertex3f(mirror->mConer[Mirror::ld].x, mirror->mConer[Mirror::ld].y, mirror->mConer[Mirror::ld].z);
-            glTexCoord2f(1.0, 1.0);
             mirror->mConer[Mirror::rd] = renderingEngine->rotate_vertex_position({+scaledHalfWidth, -scaledHalfHeight, -5.0f}, mirror->rot);
             mirror->mConer[Mirror::rd] += Vec3f(whereami);
             mirror->mConer[Mirror::rd] += Vec3f(mirror->pos);
-            glVertex3f(mirror->mConer[Mirror::rd].x, mirror->mConer[Mirror::rd].y, mirror->mConer[Mirror::rd].z);
-            glTexCoord2f(1.0, 0.0);
             mirror->mConer[Mirror::ru] = renderingEngine->rotate_vertex_position({+scaledHalfWidth, +scaledHalfHeight, -5.0f}, mirror->rot);
             mirror->mConer[Mirror::ru] += Vec3f(whereami);
             mirror->mConer[Mirror::ru] += Vec3f(mirror->pos);
-            glVertex3f(mirror->mConer[Mirror::ru].x, mirror->mConer[Mirror::ru].y, mirror->mConer[Mirror::ru].z);
-            glEnd();
-            //glPopMatrix();
+            // corners for picking and visibility, GPU makes its own
+            mirror->mCenter = Vec3f(whereami);
+            mirror->mCenter += Vec3f(mirror->pos);
+            mirror->mSlot = mInstances.add(mirrorInstance(mirror.get()), mirror->mTexture.name);
+
+            // master thread reads it any time, store once
+            auto visible{false};
+            for (auto& corner : mirror->mConer)
+            {
+                if (Vec3f(corner).normalize().dotProduct(Vec3f(lookat)) > kVisibleCos)
+                {
+                    visible = true;
+                }
+            }
+            mirror->visible = visible;
         }
-        glDisable(GL_TEXTURE_2D);
-        glEndList();
         
         mRequestSceneGeneration.post();
         static auto lastWhereAmI{whereami};
@@ -327,19 +1042,17 @@ class XServerMirror : public Client {
             }
             mMirrorWithFocus = zorder.size() ? (*zorder.begin()).second : mMirrorWithFocus;
             
-            Window windowWithFocus;
-            int rev;
-            XGetInputFocus(mDisplay, &windowWithFocus, &rev);
-            if (mDisplay != nullptr &&
+            // never talk to X from here, focus thread does it and
+            // mStates follows focus from X events
+            if (mFocusThread &&
                 mMirrorWithFocus &&
-                windowWithFocus != mMirrorWithFocus->window)
+                mStates->focus() != mMirrorWithFocus->window &&
+                mPendingFocus != mMirrorWithFocus->window &&
+                mFocusRequests.push(mMirrorWithFocus->window))
             {
-                logi_ << windowWithFocus << "\n";
-                XSetInputFocus(mDisplay,
-                               mMirrorWithFocus->window,
-                               rev,
-                               CurrentTime);
-                XMapRaised(mDisplay,  mMirrorWithFocus->window);
+                logi_ << mStates->focus() << "\n";
+                mPendingFocus = mMirrorWithFocus->window;
+                mFocusWakeup.post();
                 
                 for(auto& mirror : mMasterList)
                 {
@@ -362,16 +1075,30 @@ class XServerMirror : public Client {
     }
 
     void handleEvents(SDL_Event& event);
+    void adjustCrop(Mirror* mirror, SDL_Keycode key);
     std::experimental::optional<Window> getWindowIdFromName(const std::string& name);
-private:
+protected:
+    // no X connection, mirrors are fed by derived class
+    XServerMirror(size_t cpuBudget, size_t gpuBudget);
+
     boost::property_tree::ptree serializeList(
         const std::list<std::shared_ptr<Mirror>>& list);
+    // saved entries take matching windows out of index
+    typedef std::multimap<std::string, Window> WindowIndex;
     std::list<std::shared_ptr<Mirror>> deSerializeList(
-        const boost::property_tree::ptree& tree);
+        const boost::property_tree::ptree& tree, WindowIndex& index);
+    // (window, name) of every client window, client list order
+    std::vector<std::pair<Window, std::string>> clientWindows(Display* display, Window root);
+    // BC1 encodes of static windows, outlives mirrors posting to it
+    EncodeThread mEncoder;
     std::string mMasterListName;
     std::string mBlackListName;
     std::list<std::shared_ptr<Mirror>> mMasterList;
     std::list<std::shared_ptr<Mirror>> mBlackList;
+    // closed windows, handed from master thread to opengl thread by scene
+    // generation and kept there until uploads let go of them
+    std::list<std::shared_ptr<Mirror>> mClosed;
+    std::list<std::shared_ptr<Mirror>> mRetiring;
     uint64_t mEra;
     Display* mDisplay;
     Window mRootWindow;
@@ -379,8 +1106,59 @@ private:
     int mWidth;
     int mHeight;
     boost::interprocess::interprocess_semaphore mRequestSceneGeneration;
+    MemoryBudget mBudget;
+    // cos of half field of view used for visibility test
+    static constexpr float kVisibleCos = 0.5f;
     
     float t, u, v;
     std::shared_ptr<Mirror> mMirrorWithFocus;
+    std::unique_ptr<CaptureRecorder> mRecorder;
+    uint32_t mCycle;
+    // newest frame of each mirror not fully uploaded yet, opengl thread
+    std::map<Mirror*, std::pair<std::shared_ptr<Mirror>, std::shared_ptr<UploadFrame>>> mPendingUploads;
+    UploadScheduler mScheduler;
+    TexturePool mTexturePool;
+    // mirror quads, one instance each
+    InstanceBatch mInstances;
+    // upload side, GPU timer queries in flight with bytes they measure
+    std::list<std::pair<GLuint, size_t>> mTimerQueries;
+    // mirrors whose back texture waits for swapTextures
+    std::list<std::shared_ptr<Mirror>> mSwapReady;
+    std::mutex mSwapMtx;
+    // capture times of textures swapped in since last frame started
+    std::vector<std::chrono::steady_clock::time_point> mSwapped;
+    // generateScene event codes
+    enum
+    {
+        kScene = 0,
+        kUpload = 1,
+        kTexturesReady = 2
+    };
+    // every upload ring, so last reference is dropped on opengl thread
+    std::list<std::shared_ptr<UploadRing>> mRings;
+    std::atomic<bool> mRingFailed{false};
+    // frames fully uploaded so far, upload side counts
+    std::atomic<size_t> mUploaded{0};
+    static unsigned long envValue(const char* name, unsigned long defaultValue);
+    // windows unchanged this long go BC1, XMIRROR_COMPRESS_AFTER, 0 is off
+    std::chrono::seconds mCompressAfter{envValue("XMIRROR_COMPRESS_AFTER", 10)};
+    // windows without focus captured and kept RGB565,
+    // XMIRROR_COMPACT_BACKGROUND=0 keeps all BGRA
+    bool mCompactBackground{envValue("XMIRROR_COMPACT_BACKGROUND", 1) != 0};
+    // storage policy, opengl thread while workers wait
+    bool compactFor(const Mirror* mirror) const
+    {
+        // recordings hold BGRA
+        return mCompactBackground && !mirror->haveFocus && !mRecorder && TexturePool::compactSupported();
+    }
+
+    // focus thread state, its own connection so it never waits on workers
+    std::unique_ptr<std::thread> mFocusThread;
+    Display* mFocusDisplay;
+    SpscQueue<Window, 16> mFocusRequests;
+    boost::interprocess::interprocess_semaphore mFocusWakeup;
+    // focus requested but not yet set
+    std::atomic<Window> mPendingFocus;
+    std::unique_ptr<WindowStateCache> mStates;
 };
 
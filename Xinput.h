@@ -283,6 +283,26 @@ public:
                                     event.key.keysym.sym = SDLK_b;
                                     mCb(event);
                                     break;
+                                case 43:
+                                    event.key.keysym.sym = SDLK_h;
+                                    mCb(event);
+                                    break;
+                                case 44:
+                                    event.key.keysym.sym = SDLK_j;
+                                    mCb(event);
+                                    break;
+                                case 45:
+                                    event.key.keysym.sym = SDLK_k;
+                                    mCb(event);
+                                    break;
+                                case 46:
+                                    event.key.keysym.sym = SDLK_l;
+                                    mCb(event);
+                                    break;
+                                case 27:
+                                    event.key.keysym.sym = SDLK_r;
+                                    mCb(event);
+                                    break;
                             }
                         }
                         break;
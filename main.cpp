@@ -10,8 +10,17 @@
 #include "RenderingEngine.h"
 #include "WebCamClient.h"
 #include "XServerMirror.h"
+#include "ReplayClient.h"
+#include "StartupGraph.h"
 #include "TypesConf.h"
 
+// memory ceiling in MB taken from environment, or default
+static size_t budgetFromEnv(const char* name, size_t defaultMb)
+{
+    auto value = getenv(name);
+    return (value != nullptr ? strtoull(value, nullptr, 10) : defaultMb) << 20;
+}
+
 int main(int argc, char **arg)
 {
     std::vector<std::shared_ptr<Client> > clients;
@@ -19,29 +28,91 @@ int main(int argc, char **arg)
     logLevel["/home/darek/lnw/lnw/Projects/opencl/new_vr/XServerMirror.cpp"] = 2;
     logLevel["/home/darek/lnw/lnw/Projects/opencl/new_vr/XServerMirror.h"] = 4;
     
-    RenderingEngine REObj(argc, arg, clients);
+    // --record <file> | --replay <file> [--max-speed]
+    std::string recordFile;
+    std::string replayFile;
+    auto maxSpeed{false};
+    for (auto i{1}; i < argc; ++i)
+    {
+        std::string opt{arg[i]};
+        if (opt == "--record" && i + 1 < argc)
+        {
+            recordFile = arg[++i];
+        } else if (opt == "--replay" && i + 1 < argc)
+        {
+            replayFile = arg[++i];
+        } else if (opt == "--max-speed")
+        {
+            maxSpeed = true;
+        }
+    }
+
+    // independent subsystems come up in parallel, timeline goes to log
+    XInitThreads();
+    auto cpuBudget = budgetFromEnv("XMIRROR_CPU_BUDGET_MB", 1024);
+    auto gpuBudget = budgetFromEnv("XMIRROR_GPU_BUDGET_MB", 1024);
+    std::unique_ptr<RenderingEngine> REObj;
+    std::shared_ptr<Client> mirror;
+    std::shared_ptr<Client> camera;
+    StartupGraph startup;
+    startup.add("cursor", {}, []() { Mirror::cursorImage(); });
+    // hmd, xrandr, sdl window and shaders, gl context stays on main thread
+    startup.add("render", {}, [&]() { REObj = std::make_unique<RenderingEngine>(clients); }, true);
+    if (!replayFile.empty())
+    {
+        startup.add("replay", {}, [&]()
+        {
+            mirror = std::make_shared<ReplayClient>(replayFile, maxSpeed, cpuBudget, gpuBudget);
+        });
+    } else
+    {
+        startup.add("mirror", {"cursor"}, [&]()
+        {
+            auto xServerMirror = std::make_shared<XServerMirror>("master_list", "black_list", cpuBudget, gpuBudget);
+            if (!recordFile.empty())
+            {
+                xServerMirror->record(recordFile);
+            }
+            mirror = xServerMirror;
+        });
+        startup.add("camera", {}, [&]() { camera = std::make_shared<WebCamera>("ANY", true); });
+    }
 
     try {
-        clients.push_back(std::make_shared<XServerMirror>("master_list", "black_list"));
-        clients.push_back(std::make_shared<WebCamera>("ANY", true));
+        startup.run();
     } catch (const Error& e)
     {
         std::cout << "ERROR: Got exception with message: " << e.mMsg << "\n";
         return -1;
     }
+    startup.report();
+    clients.push_back(mirror);
+    if (camera)
+    {
+        clients.push_back(camera);
+    }
     
     // run core
     auto exit{false};
     for (auto client : clients)
     {
-        client->run(&REObj, &exit);
+        client->run(REObj.get(), &exit);
     }
-    REObj.run();
+    REObj->run();
     exit = true;
+    auto exitCode{0};
     for (auto client : clients)
     {
-        client->join();
+        if (!client->join())
+        {
+            exitCode = 1;
+        }
     }
+    // clients own textures, rings and buffers, they go while gl context
+    // is still there
+    mirror.reset();
+    camera.reset();
+    clients.clear();
    
-    return 0;
+    return exitCode;
 }